@@ -8,6 +8,38 @@
 #include <algorithm>
 #include <omp.h>
 
+/*!
+\brief Statistics on the structure of a tree.
+*/
+struct BlobTreeStats
+{
+	int nodes = 0;			//!< Number of nodes
+	int leaves = 0;			//!< Number of leaves
+	int primitives = 0;		//!< Number of primitives
+	int maxDepth = 0;		//!< Depth of the deepest leaf
+	long long depthSum = 0;	//!< Sum of leaf depths, used for computing the average depth
+	size_t memory = 0;		//!< Memory footprint in bytes
+	double overlapSum = 0.0;	//!< Sum of the overlap between the children of inner nodes, see BlobTreeBlend::Overlap()
+
+	/*!
+	\brief Average depth of the leaves.
+	*/
+	inline double AverageDepth() const
+	{
+		return leaves == 0 ? 0.0 : double(depthSum) / double(leaves);
+	}
+
+	/*!
+	\brief Average overlap between the children of inner nodes.
+	*/
+	inline double AverageOverlap() const
+	{
+		return nodes == leaves ? 0.0 : overlapSum / double(nodes - leaves);
+	}
+
+	void AddLeaf(int depth, int count, size_t bytes);
+};
+
 class BlobTreeNode
 {
 protected:
@@ -16,6 +48,7 @@ protected:
 
 public:
 	BlobTreeNode(const Box& b);
+	virtual ~BlobTreeNode();
 
 	virtual double Intensity(const Vector& p) const = 0;
 	virtual Vector Gradient(const Vector& p) const;
@@ -25,7 +58,12 @@ public:
 		return k;
 	}
 
-	virtual inline double K(const Segment&) const
+	virtual inline double K(const Segment&, bool = false) const
+	{
+		return k;
+	}
+
+	virtual inline double K(const Box&) const
 	{
 		return k;
 	}
@@ -35,17 +73,34 @@ public:
 		return box;
 	}
 
-	inline double CubicFalloff(double x, double r) const
+	virtual void Stats(BlobTreeStats& stats, int depth) const;
+	virtual void Refit(int depth);
+
+	/*!
+	\brief Check whether a box lies behind the origin of a segment, so that the segment moves away from every point of the box.
+	\param b box
+	\param s segment
+	*/
+	static inline bool Behind(const Box& b, const Segment& s)
+	{
+		Vector axis = s[1] - s[0];
+		double d = 0.0;
+		for (int i = 0; i < 3; i++)
+			d += Math::Max((b[0][i] - s[0][i]) * axis[i], (b[1][i] - s[0][i]) * axis[i]);
+		return d <= 0.0;
+	}
+
+	static inline double CubicFalloff(double x, double r)
 	{
 		return (x > r) ? 0.0 : (1.0 - x / r) * (1.0 - x / r) * (1.0 - x / r);
 	}
 
-	inline double CubicFalloffK(double e, double R) const
+	static inline double CubicFalloffK(double e, double R)
 	{
 		return 1.72 * abs(e) / R;
 	}
 
-	inline double CubicFalloffK(double a, double b, double R, double s) const
+	static inline double CubicFalloffK(double a, double b, double R, double s)
 	{
 		if (a > R * R)
 			return 0.0;
@@ -68,14 +123,48 @@ class BlobTreeBlend : public BlobTreeNode
 {
 protected:
 	BlobTreeNode* e[2]; //!< Child nodes.
+	double built;		//!< Overlap between the child nodes at construction, see Overlap().
 
 public:
 	BlobTreeBlend(BlobTreeNode* e1, BlobTreeNode* e2);
+	~BlobTreeBlend();
 
 	double Intensity(const Vector& p) const;
 	Vector Gradient(const Vector& p) const;
 	double K() const;
-	double K(const Segment& s) const;
+	double K(const Segment& s, bool directional = false) const;
+	double K(const Box& b) const;
+	void Stats(BlobTreeStats& stats, int depth) const;
+	void Refit(int depth);
+
+	/*!
+	\brief Returns a child node.
+	\param i index of the child, 0 or 1
+	*/
+	inline const BlobTreeNode* Child(int i) const
+	{
+		return e[i];
+	}
+
+	/*!
+	\brief Replace a child node, the former one should be deleted by the caller.
+	\param i index of the child, 0 or 1
+	\param n new child
+	*/
+	inline void SetChild(int i, BlobTreeNode* n)
+	{
+		e[i] = n;
+	}
+
+	double Overlap() const;
+
+	/*!
+	\brief Overlap between the child nodes when the node was built, which refitting does not change.
+	*/
+	inline double BuiltOverlap() const
+	{
+		return built;
+	}
 };
 
 class BlobTreePoint : public BlobTreeNode
@@ -89,27 +178,216 @@ public:
 	BlobTreePoint(const Vector& pp, double rr, double ee);
 
 	double Intensity(const Vector& p) const;
-	double K(const Segment& s) const;
+	double K(const Segment& s, bool directional = false) const;
+	double K(const Box& b) const;
+	void Stats(BlobTreeStats& stats, int depth) const;
 
 	static BlobTreeNode* BVHRecursive(std::vector<BlobTreeNode*>& pts, int begin, int end);
 	static BlobTreeNode* OptimizeHierarchy(std::vector<BlobTreeNode*>& pts, int begin, int end);
 	static BlobTreeNode* OptimizeHierarchy(const std::vector<Vector>& c, double r);
+
+	static double K(const Vector& c, double r, double e, const Segment& s, bool directional = false);
+	static double K(const Vector& c, double r, double e, const Box& b);
+};
+
+/*!
+\brief Quantities of a segment shared by the lipschitz bounds of all the primitives of a query.
+
+They are computed once per query rather than once per primitive, see PointBuffer::K(int, int, const SegmentQuery&, bool).
+*/
+struct SegmentQuery
+{
+	Vector a;		//!< Origin
+	Vector b;		//!< End
+	Vector axis;	//!< Unit direction
+	double length;	//!< Length
+	Vector center;	//!< Center, for the separating axis test against the boxes of the primitives
+	Vector half;	//!< Half of the segment vector
+	Vector extent;	//!< Absolute value of the half of the segment vector
+
+	/*!
+	\brief Create the query of a segment.
+	\param s segment
+	*/
+	explicit SegmentQuery(const Segment& s) : a(s[0]), b(s[1])
+	{
+		axis = Normalized(b - a);
+		length = Norm(b - a);
+		center = 0.5 * (a + b);
+		half = 0.5 * (b - a);
+		extent = Vector(fabs(half[0]), fabs(half[1]), fabs(half[2]));
+	}
+};
+
+/*!
+\brief Point primitives stored as a structure of arrays.
+
+Every primitive attribute lives in its own contiguous array, so that a range of primitives
+can be evaluated by a tight loop without any virtual call nor pointer chasing.
+*/
+class PointBuffer
+{
+public:
+	std::vector<double> cx;	//!< Center abscissa
+	std::vector<double> cy;	//!< Center ordinates
+	std::vector<double> cz;	//!< Center heights
+	std::vector<double> r;	//!< Radii
+	std::vector<double> e;	//!< Energies
+	std::vector<double> rr;		//!< Squared radii
+	std::vector<double> rr5;	//!< Squared radii divided by 5, where the derivative of the falloff peaks
+	std::vector<double> kmax;	//!< Global lipschitz constants 1.72 |e| / r
+	std::vector<double> e6;		//!< Absolute energies times 6, the factor of the derivative of the falloff
+	std::vector<int> id;	//!< Index of the primitive in the order of insertion, preserved by reordering
+	int negative;			//!< Number of primitives with a negative energy, for which the directional bounds do not hold
+
+public:
+	PointBuffer();
+
+	void Push(const Vector& c, double rr, double ee);
+	void Reorder(int begin, const std::vector<int>& index);
+	bool Write(std::ostream& out) const;
+	bool Read(std::istream& in, int count);
+
+	/*!
+	\brief Number of primitives.
+	*/
+	inline int Size() const
+	{
+		return int(r.size());
+	}
+
+	/*!
+	\brief Center of a primitive.
+	\param i primitive index
+	*/
+	inline Vector Center(int i) const
+	{
+		return Vector(cx[i], cy[i], cz[i]);
+	}
+
+	/*!
+	\brief Bounding box of a primitive.
+	\param i primitive index
+	*/
+	inline Box GetBox(int i) const
+	{
+		Vector c = Center(i);
+		return Box(c - Vector(r[i], r[i], r[i]), c + Vector(r[i], r[i], r[i]));
+	}
+
+	/*!
+	\brief Memory footprint of the primitives in bytes.
+	*/
+	inline size_t Memory() const
+	{
+		return r.size() * (9 * sizeof(double) + sizeof(int));
+	}
+
+	double Intensity(int begin, int end, const Vector& p) const;
+	double K(int begin, int end) const;
+	double K(int begin, int end, const Segment& s, bool directional = false) const;
+	double K(int begin, int end, const SegmentQuery& q, bool directional = false) const;
+	double K(int begin, int end, const Box& b) const;
+};
+
+/*!
+\brief Leaf node referencing a contiguous range of point primitives in a PointBuffer.
+*/
+class BlobTreePointBatch : public BlobTreeNode
+{
+private:
+	const PointBuffer* buffer;	//!< Primitive storage
+	int begin;					//!< First primitive
+	int end;					//!< One past the last primitive
+
+public:
+	BlobTreePointBatch(const PointBuffer* pb, int b, int e);
+
+	double Intensity(const Vector& p) const;
+	double K() const;
+	double K(const Segment& s, bool directional = false) const;
+	double K(const Box& b) const;
+	void Stats(BlobTreeStats& stats, int depth) const;
+	void Refit(int depth);
+
+	/*!
+	\brief First primitive of the leaf.
+	*/
+	inline int Begin() const
+	{
+		return begin;
+	}
+
+	/*!
+	\brief One past the last primitive of the leaf.
+	*/
+	inline int End() const
+	{
+		return end;
+	}
+
+	static BlobTreeNode* BVHRecursive(PointBuffer& pb, int begin, int end, int leafSize);
+	static BlobTreeNode* OptimizeHierarchy(PointBuffer& pb, int leafSize = 1);
 };
 
 class BlobTree
 {
 private:
 	BlobTreeNode* root;
+	PointBuffer points;	//!< Storage for point primitives, referenced by the leaves of the tree.
+	int leafSize;		//!< Maximum number of primitives per leaf, used when rebuilding the hierarchy.
 
 public:
 	BlobTree();
 	BlobTree(BlobTreeNode* rr);
-	BlobTree(const char* path);
+	BlobTree(const char* path, int leafSize = 1);
+	BlobTree(const std::vector<Vector>& centers, double radius, int leafSize = 1);
+	~BlobTree();
 
-	double Intensity(const Vector& p);
+	BlobTree(const BlobTree&) = delete;
+	BlobTree& operator=(const BlobTree&) = delete;
+
+	double Intensity(const Vector& p) const;
 	Vector Gradient(const Vector& p) const;
 	double K() const;
-	double K(const Segment& s) const;
+	double K(const Segment& s, bool directional = false) const;
+	double K(const Box& b) const;
+
+	void Intensity(const std::vector<Vector>& pts, std::vector<double>& values) const;
+	void Gradient(const std::vector<Vector>& pts, std::vector<Vector>& gradients) const;
 
 	Box GetBox() const;
+	BlobTreeStats Stats() const;
+
+	static bool Load(const char* path, std::vector<Vector>& centers);
+
+	int Update(const std::vector<Vector>& centers, double maxGrowth = 1.5, double minOverlap = 0.05);
+	void Rebuild();
+
+	/*!
+	\brief Root node of the tree.
+	*/
+	inline const BlobTreeNode* GetRoot() const
+	{
+		return root;
+	}
+
+	/*!
+	\brief Storage of the point primitives referenced by the leaves of the tree.
+	*/
+	inline const PointBuffer& GetPoints() const
+	{
+		return points;
+	}
+
+	/*!
+	\brief Iso-value of the surface.
+	*/
+	static inline double Threshold()
+	{
+		return 0.5;
+	}
+
+private:
+	BlobTreeNode* RebuildOverlapping(BlobTreeNode* node, double maxGrowth, double minOverlap, int& rebuilt);
 };
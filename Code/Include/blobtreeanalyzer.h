@@ -0,0 +1,113 @@
+#pragma once
+
+#include "blobtree.h"
+
+/*!
+\brief Queries of one kind that reached a node of a hierarchy.
+
+Indexes 0 and 1 of the arrays count Intensity and K(Segment) queries.
+*/
+struct NodeAccess
+{
+	long long reached[2] = { 0, 0 };	//!< Queries that tested the box of the node
+	long long culled[2] = { 0, 0 };		//!< Queries rejected by the box test of the node
+	long long useless[2] = { 0, 0 };	//!< Queries that passed the box test, but whose sub-tree contributed nothing
+
+	void Add(const NodeAccess& a);
+};
+
+/*!
+\brief Queries that reached the nodes of a level of a hierarchy.
+*/
+struct LevelAccess : NodeAccess
+{
+	int nodes = 0;					//!< Number of nodes of the level
+	int leaves = 0;					//!< Number of leaves of the level
+	long long primitives[2] = { 0, 0 };	//!< Primitives evaluated by the queries that passed the box test of the leaves
+};
+
+/*!
+\brief Analyzer of the traversal of the hierarchy of a BlobTree.
+
+The analyzer provides the field queries of the tree, so that tracers can be instantiated for it, and answers
+Intensity and K(Segment) queries by replaying the traversal of BlobTreeBlend and BlobTreePointBatch over a flattened
+copy of the tree, with the same box tests and the same order of summation. Values are thus identical to those of
+the tree, while every node counts the queries that reached it, were culled by its box, or passed its box for nothing.
+Counters are kept per OpenMP thread and merged by Accesses(). Nodes are indexed in depth first order, the root being
+the first one.
+*/
+class BlobTreeAnalyzer
+{
+private:
+	/*!
+	\brief Flattened node of the tree.
+	*/
+	struct Node
+	{
+		const BlobTreeNode* node;	//!< Node of the tree
+		Box box;					//!< Bounding box
+		int child[2];				//!< Children of an inner node, -1 for leaves
+		int depth;					//!< Depth
+		int begin, end;				//!< Range of primitives of a leaf, or of all the leaves of the sub-tree
+		bool leaf;					//!< True for leaves referencing a range of primitives
+	};
+
+	const BlobTree* tree;								//!< Analyzed tree
+	std::vector<Node> nodes;							//!< Nodes in depth first order
+	mutable std::vector<std::vector<NodeAccess>> threads;	//!< Counters of every OpenMP thread
+
+public:
+	explicit BlobTreeAnalyzer(const BlobTree& tree);
+
+	double Intensity(const Vector& p) const;
+	Vector Gradient(const Vector& p) const;
+	double K() const;
+	double K(const Segment& s, bool directional = false) const;
+	Box GetBox() const;
+
+	void Clear();
+	std::vector<NodeAccess> Accesses() const;
+	std::vector<LevelAccess> Levels() const;
+	bool WriteAccesses(const char* path) const;
+	void Heatmap(int query, int width, int levelHeight, std::vector<Vector>& image, int& height) const;
+
+	/*!
+	\brief Number of nodes.
+	*/
+	inline int Size() const
+	{
+		return int(nodes.size());
+	}
+
+	/*!
+	\brief Depth of a node.
+	\param i index of the node
+	*/
+	inline int Depth(int i) const
+	{
+		return nodes[i].depth;
+	}
+
+	/*!
+	\brief Number of primitives in the sub-tree of a node.
+	\param i index of the node
+	*/
+	inline int Primitives(int i) const
+	{
+		return nodes[i].end - nodes[i].begin;
+	}
+
+	/*!
+	\brief Check whether a node is a leaf.
+	\param i index of the node
+	*/
+	inline bool Leaf(int i) const
+	{
+		return nodes[i].leaf;
+	}
+
+private:
+	int Flatten(const BlobTreeNode* node, int depth);
+	double Intensity(int node, const Vector& p, NodeAccess* access) const;
+	double K(int node, const Segment& s, bool directional, NodeAccess* access) const;
+};
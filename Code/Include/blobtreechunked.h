@@ -0,0 +1,140 @@
+#pragma once
+
+#include "blobtree.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/*!
+\brief Node of the top-level tree of an out-of-core scene, stored in the scene file.
+*/
+struct ChunkNode
+{
+	double a[3];		//!< Lower corner of the bounding box
+	double b[3];		//!< Upper corner of the bounding box
+	double k;			//!< Lipschitz constant of the sub-tree
+	int32_t child[2];	//!< Children of an inner node
+	int32_t chunk;		//!< Chunk of a leaf node, -1 for an inner node
+	int32_t padding;	//!< Unused, keeps the layout identical across compilers
+};
+
+/*!
+\brief Entry of the chunk table of an out-of-core scene, stored in the scene file.
+
+The particles of a chunk are stored contiguously as triplets of doubles, starting at a page aligned offset,
+so that a chunk can be read or memory mapped in a single operation.
+*/
+struct ChunkEntry
+{
+	int64_t offset;		//!< Offset of the particles in the file
+	int32_t count;		//!< Number of particles
+	int32_t padding;	//!< Unused, keeps the layout identical across compilers
+};
+
+/*!
+\brief Statistics on the chunk cache of an out-of-core scene.
+*/
+struct ChunkCacheStats
+{
+	long long hits = 0;			//!< Queries served by a resident chunk
+	long long misses = 0;		//!< Queries that required loading a chunk
+	long long evictions = 0;	//!< Chunks evicted to stay under the memory cap
+	long long bytesRead = 0;	//!< Volume read from the scene file
+	size_t resident = 0;		//!< Memory used by resident chunks
+	size_t peak = 0;			//!< Peak memory used by resident chunks
+
+	/*!
+	\brief Ratio of chunk accesses served without reading the file.
+	*/
+	inline double HitRate() const
+	{
+		return hits + misses == 0 ? 0.0 : double(hits) / double(hits + misses);
+	}
+};
+
+/*!
+\brief Out-of-core BlobTree, for particle sets that do not fit in memory.
+
+Particles are spatially partitioned into chunks written to a scene file, together with a top-level tree over the
+chunk boxes. Only the top-level tree is resident: the BlobTree of a chunk is built when a query first reaches it,
+and kept in a least recently used cache whose memory footprint is bounded by a cap. The least recently used chunks
+are evicted first, possibly exceeding the cap by a single chunk when it is lower than the footprint of one chunk.
+Writing the scene file with Write() still requires all the particles in memory.
+
+Queries are thread safe, chunks being shared with the threads that still use them when they are evicted. A query
+reaching a resident chunk takes no lock: the tree of every chunk is an atomic shared pointer, and the recency of a
+chunk is a coarse timestamp, the cache clock advancing once per loaded chunk. A missing chunk is read and built by
+the first thread reaching it, while holding the lock of that chunk only, so that other threads needing the same
+chunk wait for it and the other chunks remain available. The lock of the cache is only taken to account for a
+loaded chunk and evict others.
+A chunk that cannot be read contributes nothing to the queries, and IsValid() returns false from then on.
+*/
+class BlobTreeChunked
+{
+private:
+	/*!
+	\brief Resident tree of a chunk and its cache state.
+	*/
+	struct Slot
+	{
+		std::shared_ptr<const BlobTree> tree;	//!< Resident tree, null if the chunk is not loaded, only accessed with std::atomic_load() and std::atomic_store()
+		std::atomic<int64_t> used{ 0 };			//!< Cache clock when the chunk was last used
+		std::atomic<long long> hits{ 0 };		//!< Queries served by the resident tree
+		std::mutex loading;						//!< Held by the thread loading the chunk
+		size_t footprint = 0;					//!< Memory used by the tree, protected by the lock of the cache
+	};
+
+	std::vector<ChunkNode> nodes;		//!< Top-level tree, the root is the first node
+	std::vector<ChunkEntry> chunks;		//!< Chunk table
+	std::string path;					//!< Scene file
+	double radius;						//!< Radius of the particles
+	int leafSize;						//!< Maximum number of primitives per leaf of the chunk trees
+	size_t memoryCap;					//!< Maximum memory used by resident chunks, in bytes
+	Box box;							//!< Bounding box
+
+	std::unique_ptr<Slot[]> slots;				//!< Cache state of every chunk
+	mutable std::atomic<int64_t> clock;			//!< Cache clock, advanced once per loaded chunk
+	mutable std::atomic<bool> failed;			//!< Set if a chunk could not be read
+	mutable std::mutex mutex;					//!< Protects the resident chunks and the statistics
+	mutable std::vector<int> resident;			//!< Resident chunks
+	mutable ChunkCacheStats cacheStats;			//!< Cache statistics, except hits which are counted per chunk
+
+public:
+	BlobTreeChunked(const char* path, size_t memoryCap, int leafSize = 4);
+
+	BlobTreeChunked(const BlobTreeChunked&) = delete;
+	BlobTreeChunked& operator=(const BlobTreeChunked&) = delete;
+
+	double Intensity(const Vector& p) const;
+	Vector Gradient(const Vector& p) const;
+	double K() const;
+	double K(const Segment& s, bool directional = false) const;
+
+	Box GetBox() const;
+	ChunkCacheStats CacheStats() const;
+
+	/*!
+	\brief Returns true if the scene file was opened, its header was read, and no chunk failed to be read since.
+	*/
+	inline bool IsValid() const
+	{
+		return !nodes.empty() && !failed.load();
+	}
+
+	/*!
+	\brief Number of chunks of the scene.
+	*/
+	inline int ChunkCount() const
+	{
+		return int(chunks.size());
+	}
+
+	static bool Write(const char* path, std::vector<Vector>& centers, double radius, int chunkSize);
+
+private:
+	std::shared_ptr<const BlobTree> Acquire(int chunk) const;
+	std::shared_ptr<const BlobTree> Load(int chunk) const;
+
+	static int Partition(std::vector<Vector>& centers, int begin, int end, double radius, int chunkSize, std::vector<ChunkNode>& nodes, std::vector<ChunkEntry>& chunks);
+};
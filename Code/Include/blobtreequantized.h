@@ -0,0 +1,57 @@
+#pragma once
+
+#include "blobtreewide.h"
+#include <cstdint>
+
+/*!
+\brief Compressed node of a wide bounding volume hierarchy.
+
+The frame of the node is stored in single precision, and child boxes are quantized to Q
+relative to this frame. Quantization is conservative: decoded child boxes always contain
+the exact ones, so culling never discards a primitive that contributes to the field.
+*/
+template<int W, typename Q>
+struct BlobTreeQuantizedNode
+{
+	float origin[3];	//!< Lower corner of the frame of the node
+	float scale[3];		//!< Size of one quantization step along every axis
+	Q a[3][W];			//!< Quantized lower corners of the child boxes
+	Q b[3][W];			//!< Quantized upper corners of the child boxes
+	int32_t child[W];	//!< Index of the child node, or first primitive of a leaf child
+	int32_t count[W];	//!< Number of primitives of a leaf child, 0 for an inner child and -1 for an empty slot
+};
+
+/*!
+\brief Wide bounding volume hierarchy with quantized child boxes, compressed from a BlobTreeWide.
+
+The hierarchy references the point primitives of the tree it was built from, which should outlive it.
+It provides the same field queries as the BlobTree, so that tracers can be instantiated for it.
+*/
+template<int W, typename Q>
+class BlobTreeQuantized
+{
+private:
+	std::vector<BlobTreeQuantizedNode<W, Q>> nodes;	//!< Nodes, the root is the first one
+	const PointBuffer* points;						//!< Primitive storage
+	Box box;										//!< Bounding box
+	double k;										//!< Global Lipschitz constant
+
+public:
+	BlobTreeQuantized(const BlobTreeWide<W>& wide);
+
+	double Intensity(const Vector& p) const;
+	Vector Gradient(const Vector& p) const;
+	double K() const;
+	double K(const Segment& s, bool directional = false) const;
+
+	Box GetBox() const;
+	BlobTreeStats Stats() const;
+
+private:
+	void Compress(const BlobTreeWide<W>& wide, int node, const Box& frame);
+	double Intensity(int node, const Vector& p) const;
+	double K(int node, const Box& s, const SegmentQuery& q, bool directional) const;
+	void Stats(int node, BlobTreeStats& stats, int depth) const;
+
+	static void Decode(const BlobTreeQuantizedNode<W, Q>& node, BlobTreeWideNode<W>& decoded);
+};
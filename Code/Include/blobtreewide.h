@@ -0,0 +1,76 @@
+#pragma once
+
+#include "blobtree.h"
+
+/*!
+\brief Node of a wide bounding volume hierarchy.
+
+Child boxes are stored as a structure of arrays, one array per axis and per corner,
+so that a point or a segment can be tested against all the children at once.
+*/
+template<int W>
+struct BlobTreeWideNode
+{
+	double a[3][W];	//!< Lower corners of the child boxes
+	double b[3][W];	//!< Upper corners of the child boxes
+	int child[W];	//!< Index of the child node, or first primitive of a leaf child
+	int count[W];	//!< Number of primitives of a leaf child, 0 for an inner child and -1 for an empty slot
+};
+
+/*!
+\brief Wide bounding volume hierarchy with W children per node, collapsed from the binary hierarchy of a BlobTree.
+
+The wide hierarchy references the point primitives of the BlobTree it was built from, which should outlive it.
+It provides the same field queries as the BlobTree, so that tracers can be instantiated for both.
+*/
+template<int W>
+class BlobTreeWide
+{
+private:
+	std::vector<BlobTreeWideNode<W>> nodes;	//!< Nodes, the root is the first one
+	const PointBuffer* points;				//!< Primitive storage
+	Box box;								//!< Bounding box
+	double k;								//!< Global Lipschitz constant
+
+public:
+	BlobTreeWide(const BlobTree& tree);
+	BlobTreeWide(const BlobTreeWide& wide, const PointBuffer* points);
+	BlobTreeWide(const char* path, PointBuffer* points);
+
+	bool Write(const char* path) const;
+
+	double Intensity(const Vector& p) const;
+	Vector Gradient(const Vector& p) const;
+	double K() const;
+	double K(const Segment& s, bool directional = false) const;
+
+	Box GetBox() const;
+	BlobTreeStats Stats() const;
+
+	/*!
+	\brief Nodes of the hierarchy, the root is the first one.
+	*/
+	inline const std::vector<BlobTreeWideNode<W>>& GetNodes() const
+	{
+		return nodes;
+	}
+
+	/*!
+	\brief Storage of the point primitives referenced by the leaves.
+	*/
+	inline const PointBuffer& GetPoints() const
+	{
+		return *points;
+	}
+
+private:
+	int Collapse(const BlobTreeNode* node, int& skipped);
+	double Intensity(int node, const Vector& p) const;
+	double K(int node, const Box& s, const SegmentQuery& q, bool directional) const;
+	void Stats(int node, BlobTreeStats& stats, int depth) const;
+
+public:
+	static int InsideMask(const BlobTreeWideNode<W>& node, const Vector& p);
+	static int OverlapMask(const BlobTreeWideNode<W>& node, const Box& box);
+	static int RayMask(const BlobTreeWideNode<W>& node, const Ray& ray, double* tmin, double* tmax, double epsilon = 1e-3);
+};
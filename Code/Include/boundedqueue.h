@@ -0,0 +1,87 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/*!
+\brief Thread-safe FIFO queue with a bounded capacity, connecting the stages of a pipeline.
+
+Producers block while the queue is full and consumers block while it is empty, so that a fast
+stage cannot run arbitrarily ahead of a slow one. Closing the queue signals the end of the stream.
+*/
+template<typename T>
+class BoundedQueue
+{
+private:
+	std::deque<T> items;				//!< Queued items
+	int capacity;						//!< Maximum number of queued items
+	bool closed;						//!< True once the producer is done
+	std::mutex mutex;					//!< Protects the items and the closed flag
+	std::condition_variable notFull;	//!< Signaled when an item is popped
+	std::condition_variable notEmpty;	//!< Signaled when an item is pushed or the queue is closed
+
+public:
+	/*!
+	\brief Constructor.
+	\param c capacity of the queue
+	*/
+	explicit BoundedQueue(int c) : capacity(c), closed(false)
+	{
+	}
+
+	/*!
+	\brief Push an item at the end of the queue, waiting for some room if the queue is full.
+	\param item the item
+	*/
+	void Push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this]() { return int(items.size()) < capacity; });
+		items.push_back(item);
+		notEmpty.notify_one();
+	}
+
+	/*!
+	\brief Pop the first item of the queue, waiting for an item if the queue is empty.
+	\param item returned item
+	\return false if the queue was closed and all its items were popped, true otherwise.
+	*/
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this]() { return !items.empty() || closed; });
+		if (items.empty())
+			return false;
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	/*!
+	\brief Pop the first item of the queue if there is one, without waiting.
+	\param item returned item
+	\return false if the queue is empty.
+	*/
+	bool TryPop(T& item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+			return false;
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	/*!
+	\brief Close the queue: no item will be pushed anymore, and consumers are released once the queue is drained.
+	*/
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notEmpty.notify_all();
+	}
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*!
+\brief Tile of a distributed render, sent by the coordinator to a worker and sent back with its pixels.
+*/
+struct DistributedTile
+{
+	int32_t x, y;	//!< Lower corner
+	int32_t w, h;	//!< Size, an empty tile asks the worker to quit
+};
+
+/*!
+\brief Message sent by a worker to the coordinator once its scene is loaded.
+*/
+struct DistributedHello
+{
+	double load;		//!< Time spent reading the binary cache, in seconds
+	int32_t threads;	//!< Number of render threads of the worker
+	int32_t id;			//!< Index of the worker given on its command line, identifies the launched process
+};
+
+std::string DistributedPath(const char* name, const char* extension);
@@ -0,0 +1,385 @@
+#ifndef __Vector4__
+#define __Vector4__
+
+#include "evector.h"
+#include <cstdint>
+#include <new>
+#include <vector>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/*!
+\brief Allocator honoring the alignment of its type, which standard allocators ignore before C++17.
+
+Arrays of padded vectors should use it, see Vector4Array, as the compiler relies on the alignment of their
+elements when copying them.
+*/
+template<typename T>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	AlignedAllocator() {}
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	/*!
+	\brief Allocate an array, the address of the block returned by operator new is stored right before it.
+	\param n number of elements
+	*/
+	T* allocate(size_t n)
+	{
+		char* block = static_cast<char*>(::operator new(n * sizeof(T) + alignof(T) + sizeof(void*)));
+		uintptr_t aligned = (uintptr_t(block) + sizeof(void*) + alignof(T) - 1) & ~uintptr_t(alignof(T) - 1);
+		reinterpret_cast<void**>(aligned)[-1] = block;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	/*!
+	\brief Release an array.
+	\param p array
+	*/
+	void deallocate(T* p, size_t)
+	{
+		::operator delete(reinterpret_cast<void**>(p)[-1]);
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+/*!
+\brief Vector padded to four double components, aligned on the width of an AVX register.
+
+The fourth component is kept at zero, so that arithmetic runs on the whole register and only reductions and
+comparisons need to ignore it. The interface follows Vector, including the dot product with operator*, and
+conversions between both types are explicit. Arrays should be allocated with AlignedAllocator.
+*/
+class Vector4
+{
+protected:
+	alignas(32) double c[4]; //!< Components, the last one is zero.
+
+public:
+	//! Empty
+	inline Vector4() { c[0] = c[1] = c[2] = c[3] = 0.0; }
+
+	/*!
+	\brief Create a vector with the same coordinates.
+	\param a Real.
+	*/
+	explicit inline Vector4(const double& a) { c[0] = c[1] = c[2] = a; c[3] = 0.0; }
+
+	/*!
+	\brief Create a vector with argument coordinates.
+	\param x, y, z Coordinates.
+	*/
+#ifdef __AVX__
+	explicit inline Vector4(const double& x, const double& y, const double& z) { _mm256_store_pd(c, _mm256_set_pd(0.0, z, y, x)); }
+#else
+	explicit inline Vector4(const double& x, const double& y, const double& z) { c[0] = x; c[1] = y; c[2] = z; c[3] = 0.0; }
+#endif
+
+	/*!
+	\brief Convert a vector.
+	\param u %Vector.
+	*/
+#ifdef __AVX__
+	explicit inline Vector4(const Vector& u) { _mm256_store_pd(c, _mm256_set_pd(0.0, u[2], u[1], u[0])); }
+#else
+	explicit inline Vector4(const Vector& u) { c[0] = u[0]; c[1] = u[1]; c[2] = u[2]; c[3] = 0.0; }
+#endif
+
+	//! Convert to a vector.
+	explicit inline operator Vector() const { return Vector(c[0], c[1], c[2]); }
+
+	//! Gets the i-th coordinate of vector.
+	inline double& operator[] (int i) { return c[i]; }
+	//! Returns the i-th coordinate of vector.
+	inline double operator[] (int i) const { return c[i]; }
+
+#ifdef __AVX__
+	/*!
+	\brief Create a vector from a register, whose last lane should be zero.
+	\param m Register.
+	*/
+	explicit inline Vector4(__m256d m) { _mm256_store_pd(c, m); }
+
+	//! Load the components in a register.
+	inline __m256d Load() const { return _mm256_load_pd(c); }
+
+	//! Overloaded.
+	inline Vector4 operator- () const { return Vector4(_mm256_sub_pd(_mm256_setzero_pd(), Load())); }
+
+	//! Destructive addition.
+	inline Vector4& operator+= (const Vector4& u) { _mm256_store_pd(c, _mm256_add_pd(Load(), u.Load())); return *this; }
+	//! Destructive subtraction.
+	inline Vector4& operator-= (const Vector4& u) { _mm256_store_pd(c, _mm256_sub_pd(Load(), u.Load())); return *this; }
+	//! Destructive scalar multiply.
+	inline Vector4& operator*= (const double& a) { _mm256_store_pd(c, _mm256_mul_pd(Load(), _mm256_set1_pd(a))); return *this; }
+
+	friend inline Vector4 operator+ (const Vector4& u, const Vector4& v) { return Vector4(_mm256_add_pd(u.Load(), v.Load())); }
+	friend inline Vector4 operator- (const Vector4& u, const Vector4& v) { return Vector4(_mm256_sub_pd(u.Load(), v.Load())); }
+	friend inline Vector4 operator* (const Vector4& u, double a) { return Vector4(_mm256_mul_pd(u.Load(), _mm256_set1_pd(a))); }
+	friend inline Vector4 operator* (const double& a, const Vector4& u) { return u * a; }
+	friend inline Vector4 operator/ (const Vector4& u, double a) { return Vector4(_mm256_div_pd(u.Load(), _mm256_set1_pd(a))); }
+
+	/*!
+	\brief Dot product, accumulated in the same order as Vector.
+	\param u, v Vectors.
+	*/
+	friend inline double operator* (const Vector4& u, const Vector4& v)
+	{
+		__m256d p = _mm256_mul_pd(u.Load(), v.Load());
+		__m128d lo = _mm256_castpd256_pd128(p);
+		return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo))) + _mm_cvtsd_f64(_mm256_extractf128_pd(p, 1));
+	}
+
+	/*!
+	\brief Scale a vector.
+	\param a Scaling vector.
+	*/
+	inline Vector4 Scale(const Vector4& a) const { return Vector4(_mm256_mul_pd(Load(), a.Load())); }
+
+	//! Inverse of the components of a vector, the last one is kept at zero.
+	inline Vector4 Inverse() const { return Vector4(_mm256_blend_pd(_mm256_div_pd(_mm256_set1_pd(1.0), Load()), _mm256_setzero_pd(), 8)); }
+
+	//! Minimum of the components of two vectors.
+	static inline Vector4 Min(const Vector4& a, const Vector4& b) { return Vector4(_mm256_min_pd(a.Load(), b.Load())); }
+	//! Maximum of the components of two vectors.
+	static inline Vector4 Max(const Vector4& a, const Vector4& b) { return Vector4(_mm256_max_pd(a.Load(), b.Load())); }
+
+	//! Absolute value of a vector.
+	friend inline Vector4 Abs(const Vector4& u) { return Vector4(_mm256_andnot_pd(_mm256_set1_pd(-0.0), u.Load())); }
+
+	/*!
+	\brief Mask of the components of a vector greater than those of another one, one bit per component.
+	\param u, v Vectors.
+	*/
+	static inline int Greater(const Vector4& u, const Vector4& v) { return _mm256_movemask_pd(_mm256_cmp_pd(u.Load(), v.Load(), _CMP_GT_OQ)) & 7; }
+
+#ifdef __AVX2__
+	//! Rotate the components of a vector, returning (y, z, x).
+	inline Vector4 Rotated() const { return Vector4(_mm256_permute4x64_pd(Load(), _MM_SHUFFLE(3, 0, 2, 1))); }
+#else
+	//! Rotate the components of a vector, returning (y, z, x).
+	inline Vector4 Rotated() const { return Vector4(c[1], c[2], c[0]); }
+#endif
+#else
+	//! Overloaded.
+	inline Vector4 operator- () const { return Vector4(-c[0], -c[1], -c[2]); }
+
+	//! Destructive addition.
+	inline Vector4& operator+= (const Vector4& u) { c[0] += u.c[0]; c[1] += u.c[1]; c[2] += u.c[2]; return *this; }
+	//! Destructive subtraction.
+	inline Vector4& operator-= (const Vector4& u) { c[0] -= u.c[0]; c[1] -= u.c[1]; c[2] -= u.c[2]; return *this; }
+	//! Destructive scalar multiply.
+	inline Vector4& operator*= (const double& a) { c[0] *= a; c[1] *= a; c[2] *= a; return *this; }
+
+	friend inline Vector4 operator+ (const Vector4& u, const Vector4& v) { return Vector4(u.c[0] + v.c[0], u.c[1] + v.c[1], u.c[2] + v.c[2]); }
+	friend inline Vector4 operator- (const Vector4& u, const Vector4& v) { return Vector4(u.c[0] - v.c[0], u.c[1] - v.c[1], u.c[2] - v.c[2]); }
+	friend inline Vector4 operator* (const Vector4& u, double a) { return Vector4(u.c[0] * a, u.c[1] * a, u.c[2] * a); }
+	friend inline Vector4 operator* (const double& a, const Vector4& u) { return u * a; }
+	friend inline Vector4 operator/ (const Vector4& u, double a) { return Vector4(u.c[0] / a, u.c[1] / a, u.c[2] / a); }
+
+	//! Dot product.
+	friend inline double operator* (const Vector4& u, const Vector4& v) { return u.c[0] * v.c[0] + u.c[1] * v.c[1] + u.c[2] * v.c[2]; }
+
+	/*!
+	\brief Scale a vector.
+	\param a Scaling vector.
+	*/
+	inline Vector4 Scale(const Vector4& a) const { return Vector4(c[0] * a.c[0], c[1] * a.c[1], c[2] * a.c[2]); }
+
+	//! Inverse of the components of a vector, the last one is kept at zero.
+	inline Vector4 Inverse() const { return Vector4(1.0 / c[0], 1.0 / c[1], 1.0 / c[2]); }
+
+	//! Minimum of the components of two vectors.
+	static inline Vector4 Min(const Vector4& a, const Vector4& b) { return Vector4(Math::Min(a.c[0], b.c[0]), Math::Min(a.c[1], b.c[1]), Math::Min(a.c[2], b.c[2])); }
+	//! Maximum of the components of two vectors.
+	static inline Vector4 Max(const Vector4& a, const Vector4& b) { return Vector4(Math::Max(a.c[0], b.c[0]), Math::Max(a.c[1], b.c[1]), Math::Max(a.c[2], b.c[2])); }
+
+	//! Absolute value of a vector.
+	friend inline Vector4 Abs(const Vector4& u) { return Vector4(fabs(u.c[0]), fabs(u.c[1]), fabs(u.c[2])); }
+
+	/*!
+	\brief Mask of the components of a vector greater than those of another one, one bit per component.
+	\param u, v Vectors.
+	*/
+	static inline int Greater(const Vector4& u, const Vector4& v) { return int(u.c[0] > v.c[0]) | (int(u.c[1] > v.c[1]) << 1) | (int(u.c[2] > v.c[2]) << 2); }
+
+	//! Rotate the components of a vector, returning (y, z, x).
+	inline Vector4 Rotated() const { return Vector4(c[1], c[2], c[0]); }
+#endif
+
+	//! Check if all the components of a vector are greater than those of another one.
+	friend inline int operator> (const Vector4& u, const Vector4& v) { return Greater(u, v) == 7; }
+	//! Check if all the components of a vector are smaller than those of another one.
+	friend inline int operator< (const Vector4& u, const Vector4& v) { return Greater(v, u) == 7; }
+
+	//! Squared Euclidean norm.
+	friend inline double SquaredNorm(const Vector4& u) { return u * u; }
+	//! Euclidean norm.
+	friend inline double Norm(const Vector4& u) { return sqrt(u * u); }
+	//! Normalized vector, the vector should not be null.
+	friend inline Vector4 Normalized(const Vector4& u) { return u * (1.0 / Norm(u)); }
+};
+
+/*!
+\brief Vector padded to four float components, aligned on the width of an SSE register.
+
+Single precision flavour of Vector4, for data that is streamed in bulk rather than accumulated, such as the
+vertices of meshes or the samples of images. The interface is the same as that of Vector4, the dot product
+summing the first three lanes only.
+*/
+class Vector4f
+{
+protected:
+	alignas(16) float c[4]; //!< Components, the last one is zero.
+
+public:
+	//! Empty
+	inline Vector4f() { c[0] = c[1] = c[2] = c[3] = 0.0f; }
+
+	/*!
+	\brief Create a vector with the same coordinates.
+	\param a Real.
+	*/
+	explicit inline Vector4f(const float& a) { c[0] = c[1] = c[2] = a; c[3] = 0.0f; }
+
+	/*!
+	\brief Create a vector with argument coordinates.
+	\param x, y, z Coordinates.
+	*/
+	explicit inline Vector4f(const float& x, const float& y, const float& z) { c[0] = x; c[1] = y; c[2] = z; c[3] = 0.0f; }
+
+	/*!
+	\brief Convert a vector, rounding its components.
+	\param u %Vector.
+	*/
+	explicit inline Vector4f(const Vector& u) { c[0] = float(u[0]); c[1] = float(u[1]); c[2] = float(u[2]); c[3] = 0.0f; }
+
+	//! Convert to a vector.
+	explicit inline operator Vector() const { return Vector(c[0], c[1], c[2]); }
+
+	//! Gets the i-th coordinate of vector.
+	inline float& operator[] (int i) { return c[i]; }
+	//! Returns the i-th coordinate of vector.
+	inline float operator[] (int i) const { return c[i]; }
+
+#ifdef __AVX__
+	/*!
+	\brief Create a vector from a register, whose last lane should be zero.
+	\param m Register.
+	*/
+	explicit inline Vector4f(__m128 m) { _mm_store_ps(c, m); }
+
+	//! Load the components in a register.
+	inline __m128 Load() const { return _mm_load_ps(c); }
+
+	//! Overloaded.
+	inline Vector4f operator- () const { return Vector4f(_mm_sub_ps(_mm_setzero_ps(), Load())); }
+
+	//! Destructive addition.
+	inline Vector4f& operator+= (const Vector4f& u) { _mm_store_ps(c, _mm_add_ps(Load(), u.Load())); return *this; }
+	//! Destructive subtraction.
+	inline Vector4f& operator-= (const Vector4f& u) { _mm_store_ps(c, _mm_sub_ps(Load(), u.Load())); return *this; }
+	//! Destructive scalar multiply.
+	inline Vector4f& operator*= (const float& a) { _mm_store_ps(c, _mm_mul_ps(Load(), _mm_set1_ps(a))); return *this; }
+
+	friend inline Vector4f operator+ (const Vector4f& u, const Vector4f& v) { return Vector4f(_mm_add_ps(u.Load(), v.Load())); }
+	friend inline Vector4f operator- (const Vector4f& u, const Vector4f& v) { return Vector4f(_mm_sub_ps(u.Load(), v.Load())); }
+	friend inline Vector4f operator* (const Vector4f& u, float a) { return Vector4f(_mm_mul_ps(u.Load(), _mm_set1_ps(a))); }
+	friend inline Vector4f operator* (const float& a, const Vector4f& u) { return u * a; }
+	friend inline Vector4f operator/ (const Vector4f& u, float a) { return Vector4f(_mm_div_ps(u.Load(), _mm_set1_ps(a))); }
+
+	//! Dot product, only the first three lanes are summed.
+	friend inline float operator* (const Vector4f& u, const Vector4f& v) { return _mm_cvtss_f32(_mm_dp_ps(u.Load(), v.Load(), 0x71)); }
+
+	/*!
+	\brief Scale a vector.
+	\param a Scaling vector.
+	*/
+	inline Vector4f Scale(const Vector4f& a) const { return Vector4f(_mm_mul_ps(Load(), a.Load())); }
+
+	//! Minimum of the components of two vectors.
+	static inline Vector4f Min(const Vector4f& a, const Vector4f& b) { return Vector4f(_mm_min_ps(a.Load(), b.Load())); }
+	//! Maximum of the components of two vectors.
+	static inline Vector4f Max(const Vector4f& a, const Vector4f& b) { return Vector4f(_mm_max_ps(a.Load(), b.Load())); }
+
+	//! Inverse of the components of a vector, the last one is kept at zero.
+	inline Vector4f Inverse() const { return Vector4f(_mm_blend_ps(_mm_div_ps(_mm_set1_ps(1.0f), Load()), _mm_setzero_ps(), 8)); }
+
+	//! Absolute value of a vector.
+	friend inline Vector4f Abs(const Vector4f& u) { return Vector4f(_mm_andnot_ps(_mm_set1_ps(-0.0f), u.Load())); }
+
+	/*!
+	\brief Mask of the components of a vector greater than those of another one, one bit per component.
+	\param u, v Vectors.
+	*/
+	static inline int Greater(const Vector4f& u, const Vector4f& v) { return _mm_movemask_ps(_mm_cmpgt_ps(u.Load(), v.Load())) & 7; }
+#else
+	//! Overloaded.
+	inline Vector4f operator- () const { return Vector4f(-c[0], -c[1], -c[2]); }
+
+	//! Destructive addition.
+	inline Vector4f& operator+= (const Vector4f& u) { c[0] += u.c[0]; c[1] += u.c[1]; c[2] += u.c[2]; return *this; }
+	//! Destructive subtraction.
+	inline Vector4f& operator-= (const Vector4f& u) { c[0] -= u.c[0]; c[1] -= u.c[1]; c[2] -= u.c[2]; return *this; }
+	//! Destructive scalar multiply.
+	inline Vector4f& operator*= (const float& a) { c[0] *= a; c[1] *= a; c[2] *= a; return *this; }
+
+	friend inline Vector4f operator+ (const Vector4f& u, const Vector4f& v) { return Vector4f(u.c[0] + v.c[0], u.c[1] + v.c[1], u.c[2] + v.c[2]); }
+	friend inline Vector4f operator- (const Vector4f& u, const Vector4f& v) { return Vector4f(u.c[0] - v.c[0], u.c[1] - v.c[1], u.c[2] - v.c[2]); }
+	friend inline Vector4f operator* (const Vector4f& u, float a) { return Vector4f(u.c[0] * a, u.c[1] * a, u.c[2] * a); }
+	friend inline Vector4f operator* (const float& a, const Vector4f& u) { return u * a; }
+	friend inline Vector4f operator/ (const Vector4f& u, float a) { return Vector4f(u.c[0] / a, u.c[1] / a, u.c[2] / a); }
+
+	//! Dot product.
+	friend inline float operator* (const Vector4f& u, const Vector4f& v) { return u.c[0] * v.c[0] + u.c[1] * v.c[1] + u.c[2] * v.c[2]; }
+
+	/*!
+	\brief Scale a vector.
+	\param a Scaling vector.
+	*/
+	inline Vector4f Scale(const Vector4f& a) const { return Vector4f(c[0] * a.c[0], c[1] * a.c[1], c[2] * a.c[2]); }
+
+	//! Minimum of the components of two vectors.
+	static inline Vector4f Min(const Vector4f& a, const Vector4f& b) { return Vector4f(a.c[0] < b.c[0] ? a.c[0] : b.c[0], a.c[1] < b.c[1] ? a.c[1] : b.c[1], a.c[2] < b.c[2] ? a.c[2] : b.c[2]); }
+	//! Maximum of the components of two vectors.
+	static inline Vector4f Max(const Vector4f& a, const Vector4f& b) { return Vector4f(a.c[0] > b.c[0] ? a.c[0] : b.c[0], a.c[1] > b.c[1] ? a.c[1] : b.c[1], a.c[2] > b.c[2] ? a.c[2] : b.c[2]); }
+
+	//! Inverse of the components of a vector, the last one is kept at zero.
+	inline Vector4f Inverse() const { return Vector4f(1.0f / c[0], 1.0f / c[1], 1.0f / c[2]); }
+
+	//! Absolute value of a vector.
+	friend inline Vector4f Abs(const Vector4f& u) { return Vector4f(fabsf(u.c[0]), fabsf(u.c[1]), fabsf(u.c[2])); }
+
+	/*!
+	\brief Mask of the components of a vector greater than those of another one, one bit per component.
+	\param u, v Vectors.
+	*/
+	static inline int Greater(const Vector4f& u, const Vector4f& v) { return int(u.c[0] > v.c[0]) | (int(u.c[1] > v.c[1]) << 1) | (int(u.c[2] > v.c[2]) << 2); }
+#endif
+
+	//! Check if all the components of a vector are greater than those of another one.
+	friend inline int operator> (const Vector4f& u, const Vector4f& v) { return Greater(u, v) == 7; }
+	//! Check if all the components of a vector are smaller than those of another one.
+	friend inline int operator< (const Vector4f& u, const Vector4f& v) { return Greater(v, u) == 7; }
+
+	//! Squared Euclidean norm.
+	friend inline float SquaredNorm(const Vector4f& u) { return u * u; }
+	//! Euclidean norm.
+	friend inline float Norm(const Vector4f& u) { return sqrtf(u * u); }
+	//! Normalized vector, the vector should not be null.
+	friend inline Vector4f Normalized(const Vector4f& u) { return u * (1.0f / Norm(u)); }
+};
+
+typedef std::vector<Vector4, AlignedAllocator<Vector4>> Vector4Array;	//!< Array of padded vectors
+typedef std::vector<Vector4f, AlignedAllocator<Vector4f>> Vector4fArray;	//!< Array of padded single precision vectors
+
+#endif
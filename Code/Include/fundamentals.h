@@ -1,5 +1,6 @@
 #pragma once
 #include "evector.h"
+#include <vector>
 
 // Annoying & useless MSVC warning
 #pragma warning(disable: 6387 26812)
@@ -12,8 +13,9 @@ inline double Epsilon()
 class Ray
 {
 public:
-	Vector o;
-	Vector d;
+	Vector o;	//!< Origin
+	Vector d;	//!< Direction
+	Vector inv;	//!< Inverse of the direction, computed once for the slab tests against boxes
 
 	Ray(const Vector& pp, const Vector& dd);
 	Vector operator()(double t) const;
@@ -52,3 +54,62 @@ public:
 	bool Intersect(const Box& box) const;
 	Box GetBox() const;
 };
+
+/*!
+\brief Pinhole camera looking at the origin, with the field of view of a 35mm lens.
+
+The basis and the per-column and per-row offsets of the view port are computed once,
+so that generating the ray of a pixel only costs two additions and a normalization.
+*/
+class Camera
+{
+private:
+	Vector eye;						//!< Position
+	int width;						//!< Image width
+	int height;						//!< Image height
+	Vector view;					//!< Direction of the center of the view port
+	std::vector<Vector> columns;	//!< Horizontal offset of every column on the view port
+	std::vector<Vector> rows;		//!< Vertical offset of every row on the view port
+	Vector dx;						//!< Offset between two columns
+	Vector dy;						//!< Offset between two rows
+
+public:
+	Camera(const Vector& eye, int width, int height);
+
+	static bool Valid(const Vector& eye);
+
+	/*!
+	\brief Compute the ray going through a pixel.
+	\param px, py pixel coordinates
+	*/
+	inline Ray PixelRay(int px, int py) const
+	{
+		return Ray(eye, Normalized(view + columns[px] + rows[py]));
+	}
+
+	/*!
+	\brief Compute a ray going through a pixel at a sub-pixel offset.
+	\param px, py pixel coordinates
+	\param ox, oy offset from the pixel, in pixels
+	*/
+	inline Ray PixelRay(int px, int py, double ox, double oy) const
+	{
+		return Ray(eye, Normalized(view + columns[px] + rows[py] + dx * ox + dy * oy));
+	}
+
+	/*!
+	\brief Image width.
+	*/
+	inline int Width() const
+	{
+		return width;
+	}
+
+	/*!
+	\brief Image height.
+	*/
+	inline int Height() const
+	{
+		return height;
+	}
+};
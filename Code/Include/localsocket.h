@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*!
+\brief Stream sockets between the processes of a machine, named by a path of the file system.
+
+Sockets are plain descriptors, -1 standing for an invalid socket. Messages are sent and received whole:
+Send() and Receive() loop over partial transfers, and fail if the peer closed the connection.
+Unix domain sockets are only available on POSIX systems, elsewhere every function fails.
+*/
+class LocalSocket
+{
+public:
+	static int Listen(const char* path, int backlog);
+	static int Accept(int listener, int timeout);
+	static int Connect(const char* path);
+	static void Close(int socket);
+
+	static bool Send(int socket, const void* data, size_t size);
+	static bool Receive(int socket, void* data, size_t size);
+	static int Wait(const std::vector<int>& sockets, int timeout);
+};
+
+/*!
+\brief Processes launched from the running executable, such as the workers of a distributed render.
+*/
+class LocalProcess
+{
+public:
+	static int Spawn(const std::vector<std::string>& args, int threads);
+	static bool Join(int process);
+	static int Id();
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "evector.h"
+#include <cstddef>
+
+// Render modes, selected by the arguments remaining after the render settings, see main()
+void RenderMethods(Vector** pixels, Vector** pixelsCost);
+void RenderSequence(const char* pattern, int first, int last, Vector** pixels, Vector** pixelsCost);
+bool ConvertChunks(const char* path, int chunkSize);
+bool RenderOutOfCore(const char* path, size_t memoryCap, Vector** pixels, Vector** pixelsCost);
+void Serve();
+void RenderProgressive(Vector** pixels, Vector** pixelsCost);
+void RenderAntialiased(Vector** pixels, Vector** pixelsCost);
+void RenderShaded(int aoRays, Vector** pixels, Vector** pixelsCost);
+void RenderOctree(int maxDepth, Vector** pixels, Vector** pixelsCost);
+void RenderNuma(Vector** pixels, Vector** pixelsCost);
+bool RenderDistributed(int maxWorkers, int tileSize, Vector** pixels, Vector** pixelsCost);
+bool RenderWorker(const char* socket, const char* cache, int id);
+bool Polygonize(int resolution, int blockSize);
+bool AnalyzeHierarchy(Vector** pixels, Vector** pixelsCost);
+
+// Benchmarks, those returning a boolean check their results and return false on a mismatch
+void BenchmarkLeafSize(Vector** pixels, Vector** pixelsCost);
+void BenchmarkRefit(Vector** pixels, Vector** pixelsCost);
+bool BenchmarkRefine();
+void BenchmarkBounds();
+void BenchmarkVector();
+bool BenchmarkKernel();
+bool BenchmarkSlab();
+void BenchmarkQueries();
+void BenchmarkProfiler(Vector** pixels, Vector** pixelsCost);
+
+bool SelfCheck(Vector** pixels, Vector** pixelsCost);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*!
+\brief Placement of a block of memory over the NUMA nodes, sampled one page at a time.
+*/
+struct NumaPlacement
+{
+	bool available = false;		//!< False if the node of the pages could not be queried
+	long long local = 0;		//!< Pages on the expected node
+	long long remote = 0;		//!< Pages on another node
+};
+
+/*!
+\brief NUMA nodes of the machine and their processors.
+
+On Linux, the online nodes are listed by /sys/devices/system/node/online, threads are pinned with sched_setaffinity
+and the node of a page is queried with get_mempolicy. Nodes without processors, such as memory-only nodes, are
+left out, so that nodes are indexed from 0 to Nodes() - 1 while Id() keeps the identifier of the kernel, which is
+the one returned by NodeOf(). Elsewhere, or if no node is found, the machine is a single node 0 holding all the
+hardware threads and pinning does nothing. Memory is placed by the first thread touching it, so that a copy
+made by a thread pinned on a node lives on that node.
+*/
+class NumaTopology
+{
+private:
+	std::vector<int> ids;				//!< Identifier of every node
+	std::vector<std::vector<int>> cpus;	//!< Processors of every node
+
+public:
+	NumaTopology();
+
+	/*!
+	\brief Number of nodes.
+	*/
+	inline int Nodes() const
+	{
+		return int(cpus.size());
+	}
+
+	/*!
+	\brief Identifier of a node, as used by the kernel and returned by NodeOf().
+	\param node index of the node
+	*/
+	inline int Id(int node) const
+	{
+		return ids[node];
+	}
+
+	/*!
+	\brief Processors of a node.
+	\param node index of the node
+	*/
+	inline const std::vector<int>& Cpus(int node) const
+	{
+		return cpus[node];
+	}
+
+	static bool Pin(int cpu);
+	static int NodeOf(const void* address);
+	static void Place(const void* data, size_t size, int id, NumaPlacement& placement);
+};
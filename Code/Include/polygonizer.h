@@ -0,0 +1,99 @@
+#pragma once
+
+#include "blobtree.h"
+#include <vector>
+
+/*!
+\brief Indexed triangle mesh.
+*/
+struct Mesh
+{
+	std::vector<Vector> vertices;	//!< Vertex positions
+	std::vector<Vector> normals;	//!< Unit vertex normals, pointing outside
+	std::vector<int> triangles;		//!< Vertex indexes, three per triangle
+
+	bool Write(const char* path) const;
+};
+
+/*!
+\brief Statistics on a polygonization.
+*/
+struct PolygonizerStats
+{
+	long long cells = 0;				//!< Cells of the grid
+	long long prunedCells = 0;			//!< Cells proven empty by the lipschitz bound of the box of a block
+	long long evaluatedCells = 0;		//!< Cells whose corners were evaluated
+	long long surfaceCells = 0;			//!< Cells crossed by the surface, one vertex each
+	long long blockTests = 0;			//!< Blocks tested against the lipschitz bound
+	long long intensityQueries = 0;		//!< Evaluations of the field, including the gradients
+	double pruneTime = 0.0;				//!< Time spent pruning blocks, in seconds
+	double evaluateTime = 0.0;			//!< Time spent evaluating the cells of the remaining blocks, in seconds
+	double meshTime = 0.0;				//!< Time spent connecting the vertices, in seconds
+};
+
+/*!
+\brief Polygonization of the surface of a BlobTree by dual contouring over a regular grid.
+
+The grid is covered by an octree of blocks of cells. A block is pruned with its whole sub-tree as soon as
+|f(c)| > K r, where c is the center of the box of the block, r its half diagonal and K the lipschitz
+constant of the tree over the box, which proves that the surface does not cross the block. The cells
+of the remaining leaf blocks are evaluated in parallel, and every cell crossed by the surface gets one
+vertex minimizing the distance to the tangent planes at the crossings of its edges. Vertices of the four
+cells around every crossed edge are finally connected by a quad.
+*/
+class Polygonizer
+{
+private:
+	const BlobTree& tree;	//!< The tree
+	Box box;				//!< Box of the grid
+	double h;				//!< Size of the cells
+	int n[3];				//!< Number of cells along each axis
+	int blockSize;			//!< Number of cells along the sides of the leaf blocks, a power of two
+
+public:
+	Polygonizer(const BlobTree& tree, int resolution, int blockSize = 4);
+
+	void Polygonize(Mesh& mesh, PolygonizerStats& stats, bool prune = true) const;
+
+private:
+	/*!
+	\brief Leaf block of cells that could not be pruned.
+	*/
+	struct Block
+	{
+		int x, y, z;	//!< First cell
+		int size;		//!< Number of cells along the sides
+	};
+
+	/*!
+	\brief Cell crossed by the surface.
+	*/
+	struct SurfaceCell
+	{
+		long long index;	//!< Index of the cell in the grid
+		int corners;		//!< Inside corners, one bit per corner
+		Vector p;			//!< Vertex
+		Vector normal;		//!< Normal at the vertex
+	};
+
+	/*!
+	\brief Position of a vertex of the grid.
+	\param x, y, z integer coordinates of the vertex
+	*/
+	inline Vector Vertex(int x, int y, int z) const
+	{
+		return box[0] + h * Vector(x, y, z);
+	}
+
+	/*!
+	\brief Index of a cell in the grid.
+	\param x, y, z integer coordinates of the cell
+	*/
+	inline long long Cell(int x, int y, int z) const
+	{
+		return (long long)(z * n[1] + y) * n[0] + x;
+	}
+
+	bool Prunable(const Block& block, long long& queries) const;
+	void Evaluate(const Block& block, std::vector<SurfaceCell>& cells, long long& queries) const;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+\brief Timed scope recorded by the profiler.
+*/
+struct ProfileEvent
+{
+	const char* name;	//!< Name of the scope, which should be a string literal
+	int64_t begin;		//!< Start in nanoseconds since the profiler was enabled
+	int64_t duration;	//!< Duration in nanoseconds
+};
+
+/*!
+\brief Events recorded by a thread, in a ring buffer keeping the latest ones.
+*/
+struct ProfileBuffer
+{
+	std::vector<ProfileEvent> events;	//!< Ring buffer
+	uint64_t count = 0;					//!< Number of recorded events, including the overwritten ones
+	int thread = 0;						//!< Index of the thread, in the order of their first event
+};
+
+/*!
+\brief Profiler recording timed scopes, see ProfileScope.
+
+Every thread records its events in its own ring buffer, allocated on its first event, so that recording takes
+no lock. Buffers outlive their threads and are exported as a Chrome trace, which can be opened in chrome://tracing
+or in Perfetto. Exporting and clearing should only happen while no thread records events.
+
+When the profiler is disabled, a scope costs a relaxed load of a flag and two predictable branches.
+*/
+class Profiler
+{
+private:
+	static std::atomic<bool> enabled;						//!< True if scopes are recorded
+	static const std::chrono::steady_clock::time_point start;	//!< Origin of the timestamps
+
+public:
+	static const int Capacity = 1 << 18;	//!< Number of events kept per thread, a power of two
+
+	/*!
+	\brief Check if scopes are recorded.
+	*/
+	static inline bool Enabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	\brief Current timestamp in nanoseconds.
+	*/
+	static inline int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	static void Enable(bool e);
+	static void Record(const char* name, int64_t begin, int64_t end);
+	static void Clear();
+	static uint64_t Recorded();
+	static uint64_t Dropped();
+	static bool Export(const char* path);
+
+private:
+	static ProfileBuffer* Buffer();
+};
+
+/*!
+\brief Scope timed by the profiler, from its construction to its destruction.
+\code
+{
+	ProfileScope scope("Render tile");
+	// ...
+}
+\endcode
+*/
+class ProfileScope
+{
+private:
+	const char* name;	//!< Name of the scope
+	int64_t begin;		//!< Start of the scope, negative if the profiler was disabled
+
+public:
+	/*!
+	\brief Start a scope.
+	\param n name of the scope, which should be a string literal
+	*/
+	explicit inline ProfileScope(const char* n) : name(n), begin(Profiler::Enabled() ? Profiler::Now() : -1)
+	{
+	}
+
+	/*!
+	\brief End the scope, and record it if the profiler was enabled at its start.
+	*/
+	inline ~ProfileScope()
+	{
+		if (begin >= 0)
+			Profiler::Record(name, begin, Profiler::Now());
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+/*!
+\brief Enable the profiler for the lifetime of the object, and export the trace when it is destroyed.
+*/
+class ProfileSession
+{
+private:
+	std::string path;	//!< Path of the trace, the profiler is not enabled if empty
+
+public:
+	explicit ProfileSession(const std::string& path);
+	~ProfileSession();
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "evector.h"
+#include <string>
+
+/*!
+\brief Render request received by the render server, one JSON object per line.
+
+Recognized keys are "id", "width", "height", "camera" (array of three numbers), "method" ("sphere", "enhanced" or "segment"),
+"output" (path of the image) and "command" ("render", the default, "stats" or "quit").
+Missing keys keep the value they had in the request, which the server sets to the render settings. Width and height
+are at most MaxSize, and the camera must not lie on the z axis, see Camera::Valid().
+\code
+{"id": 3, "width": 256, "height": 256, "camera": [0, -60, 20], "method": "segment", "output": "view3.ppm"}
+\endcode
+*/
+struct RenderRequest
+{
+	int id = 0;								//!< Identifier, echoed in the response
+	std::string command = "render";			//!< Command
+	int width = 500;						//!< Image width
+	int height = 500;						//!< Image height
+	Vector camera = Vector(0.0, -80.0, 0.0);	//!< Camera position, looking at the origin
+	int method = 2;							//!< Raytracing method, segment tracing by default
+	std::string output;						//!< Path of the image, view<id>.ppm if empty
+
+	static const int MaxSize = 4096;		//!< Largest width and height of an image, so that a request cannot exhaust the memory
+
+	static bool Parse(const std::string& line, RenderRequest& request);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "evector.h"
+#include <string>
+#include <vector>
+
+/*!
+\brief Options of the tracers that are not template parameters, given to every traced ray.
+*/
+struct TraceOptions
+{
+	double tolerance = 0.0;	//!< Tolerance of the refinement of intersections, 0 disables the refinement
+	double minStep = 1e-3;	//!< Minimum marching step
+};
+
+/*!
+\brief Render parameters, set from the command line or from a configuration file.
+
+Options are given as "--key value", and configuration files hold one "key value" pair per line,
+with the same keys and '#' starting a comment. Options are applied in order, so that options
+following "--config file" override the values of the file.
+
+Keys are width, height, camera (three numbers, off the z axis), method (sphere, enhanced, segment or all),
+scene, leaf-size, hierarchy-width (2, 4 or 8), quantization (0, 8 or 16), refine (tolerance of the refinement
+of intersections, 0 to disable it), min-step (minimum marching step), bound (sum or directional, the local lipschitz bound of segment tracing)
+and trace (path of a Chrome trace of the profiled scopes, see Profiler).
+*/
+struct RenderSettings
+{
+	int width = 500;										//!< Image width
+	int height = 500;										//!< Image height
+	Vector camera = Vector(0.0, -80.0, 0.0);				//!< Camera position, looking at the origin
+	int method = -1;										//!< Raytracing method, -1 for all of them
+	std::string scene = "../Scenes/particles.txt";			//!< Particle file
+	int leafSize = 4;										//!< Maximum number of primitives per leaf of the hierarchy
+	int hierarchyWidth = 4;									//!< Number of children per node of the hierarchy used for rendering: 2, 4 or 8
+	int quantizationBits = 0;								//!< Quantization of the child boxes of wide hierarchies: 0 (uncompressed), 8 or 16
+	TraceOptions tracing;									//!< Refinement tolerance and minimum marching step of the tracers
+	bool directionalBound = false;							//!< Segment tracing only bounds the increase of the field along segments, see BlobTree::K(const Segment&, bool)
+	std::string trace;										//!< Path of the Chrome trace written on exit, the profiler is disabled if empty
+	std::vector<std::string> loading;						//!< Configuration files being loaded, for rejecting files that include themselves
+
+	bool Parse(int argc, char** argv, std::vector<std::string>& args);
+	bool Load(const char* path);
+	bool Set(const std::string& key, const std::vector<std::string>& values);
+	std::vector<std::string> Arguments() const;
+
+	static void Usage();
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "blobtree.h"
+#include <cstdint>
+
+/*!
+\brief Label of a cell of a SpaceOctree.
+*/
+enum SpaceLabel
+{
+	EmptySpace = 0,		//!< The field is negative over the whole cell
+	FullSpace = 1,		//!< The field is positive over the whole cell
+	SurfaceSpace = 2	//!< The surface may cross the cell
+};
+
+/*!
+\brief Statistics on the structure of a SpaceOctree.
+*/
+struct SpaceOctreeStats
+{
+	int nodes = 0;				//!< Number of nodes
+	int leaves[3] = { 0 };		//!< Number of leaves with every label
+	int depth = 0;				//!< Depth of the deepest leaf
+	size_t memory = 0;			//!< Memory footprint in bytes
+	long long queries = 0;		//!< Evaluations of the field and of the lipschitz bound during construction
+	double buildTime = 0.0;		//!< Construction time in seconds
+};
+
+/*!
+\brief Sparse octree classifying space into provably empty, full and surface cells.
+
+A cell is empty if f(c) < -K r and full if f(c) > K r, where c is its center, r its half diagonal and K
+the lipschitz constant of the tree over its box. Only surface cells are subdivided, so the number of nodes
+grows with the area of the surface rather than with the volume. Tracers locate the leaf containing a sample
+in O(log n) and jump to the exit of empty leaves without evaluating the field. As the exit of the other
+leaves is returned as well, tracers only locate their samples again once they leave the current leaf.
+*/
+class SpaceOctree
+{
+private:
+	/*!
+	\brief Node of the octree, the eight children of an inner node are stored consecutively.
+	*/
+	struct Node
+	{
+		int32_t children;	//!< Index of the first child, -1 for a leaf
+		int32_t label;		//!< Label of the cell, see SpaceLabel
+	};
+
+	std::vector<Node> nodes;	//!< Nodes, the root first
+	Box box;					//!< Box of the root
+	Vector scale;				//!< Scaling from the box of the root to the lattice of the cells of the deepest level
+	SpaceOctreeStats stats;		//!< Statistics gathered during construction
+
+public:
+	SpaceOctree(const BlobTree& tree, int maxDepth);
+
+	SpaceLabel Locate(const Ray& ray, double t, double& exit) const;
+
+	/*!
+	\brief Returns the statistics on the structure of the octree.
+	*/
+	inline SpaceOctreeStats Stats() const
+	{
+		return stats;
+	}
+
+private:
+	/*!
+	\brief Box of a child of a cell.
+	\param cell box of the cell
+	\param i index of the child, bits 0, 1 and 2 select the upper half along x, y and z
+	*/
+	static inline Box Child(const Box& cell, int i)
+	{
+		Vector a = cell[0];
+		Vector b = cell[1];
+		Vector c = cell.Center();
+		for (int j = 0; j < 3; j++)
+		{
+			if ((i >> j) & 1)
+				a[j] = c[j];
+			else
+				b[j] = c[j];
+		}
+		return Box(a, b);
+	}
+
+	static SpaceLabel Classify(const BlobTree& tree, const Box& cell);
+};
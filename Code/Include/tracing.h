@@ -0,0 +1,448 @@
+#pragma once
+
+#include "blobtree.h"
+#include "profiler.h"
+#include "rendersettings.h"
+#include "spaceoctree.h"
+#include <chrono>
+#include <vector>
+
+// Render parameters as global variables, set from the command line, see RenderSettings
+extern RenderSettings settings;
+extern const Vector sunDir;
+extern BlobTree* tree;
+
+enum RayTraceMethod
+{
+	SphereTracing = 0,
+	EnhancedSphereTracing = 1,
+	SegmentTracing = 2,
+	COUNT = 3
+};
+
+/*!
+\brief Elapsed time in seconds between two time points.
+*/
+inline double Seconds(const std::chrono::steady_clock::time_point& begin, const std::chrono::steady_clock::time_point& end)
+{
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+/*!
+\brief Stepping policy of the tracer, i.e. how the Lipschitz bound driving the step is computed.
+*/
+enum StepPolicy
+{
+	GlobalBound = 0,	//!< Global Lipschitz constant of the tree, as in sphere tracing.
+	SegmentBound = 1,	//!< Local Lipschitz constant over the next candidate segment, as in segment tracing.
+	DirectionalBound = 2,	//!< Local bound on the increase of the field along the next candidate segment, see BlobTree::K(const Segment&, bool).
+};
+
+/*!
+\brief Amount of statistics gathered by the tracer.
+*/
+enum Instrumentation
+{
+	NoStats = 0,		//!< Nothing is counted, the cost image is left black.
+	StepCount = 1,		//!< Count the number of field queries along the ray.
+};
+
+/*!
+\brief Refine an intersection bracketed by a sample outside and a sample inside the surface.
+
+Uses the Illinois variant of regula falsi, which keeps the root bracketed and does not stall on one side,
+with a bounded number of iterations.
+\param field implicit field
+\param ray the ray
+\param ta, ia depth and intensity of the sample outside, ia <= 0
+\param tb, ib depth and intensity of the sample inside, ib > 0
+\param tolerance width of the bracket to reach
+\param s step count, incremented by the number of field queries
+\return depth of the refined sample inside the surface.
+*/
+template<Instrumentation instrumentation, typename Field>
+inline double Refine(const Field* field, const Ray& ray, double ta, double ia, double tb, double ib, double tolerance, int& s)
+{
+	const int maxIterations = 16;
+	int side = 0;
+	for (int n = 0; n < maxIterations && tb - ta > tolerance; n++)
+	{
+		double t = (ta * ib - tb * ia) / (ib - ia);
+		if (!(t > ta && t < tb))
+			t = 0.5 * (ta + tb);
+		if (instrumentation >= StepCount)
+			s++;
+		double i = field->Intensity(ray(t));
+		if (i > 0.0)
+		{
+			tb = t;
+			ib = i;
+			if (side == 1)
+				ia *= 0.5;
+			side = 1;
+		}
+		else
+		{
+			ta = t;
+			ia = i;
+			if (side == -1)
+				ib *= 0.5;
+			side = -1;
+		}
+	}
+	return tb;
+}
+
+/*!
+\brief Generic tracer for a ray, specialized at compile time.
+
+Sphere tracing, enhanced sphere tracing and segment tracing share the same marching loop and
+only differ by the bound used for computing the safe stepping distance, and by the overstep and
+acceleration factors. Those are template parameters so that every configuration gets its own
+fully inlined kernel instead of testing them at every step.
+
+If the tolerance of the options is positive, the intersection is refined between the last sample outside
+and the first sample inside the surface, so that the final step can overshoot.
+\param field implicit field, either the BlobTree or a hierarchy built from it
+\param ray the ray
+\param k global lipschitz constant, unused by segment tracing
+\param options refinement tolerance and minimum marching step
+\param t returned intersection depth
+\param s returned step count
+\param hint expected intersection depth, for instance the one of a neighbouring ray, used as the first candidate segment of segment tracing;
+the candidate is still bounded by the local Lipschitz constant, so a wrong hint only costs steps, 0 for no hint
+\tparam policy stepping policy
+\tparam overstep overstep factor in hundredths, in [100, 200]
+\tparam acceleration acceleration factor in hundredths, defining the stepping distance increase factor of segment tracing
+\tparam instrumentation level of instrumentation
+\return true of intersection occured, false otherwise.
+*/
+template<StepPolicy policy, int overstep, int acceleration, Instrumentation instrumentation, typename Field>
+inline bool Trace(const Field* field, const Ray& ray, double k, const TraceOptions& options, double& t, int& s, double hint = 0.0)
+{
+	const double e = double(overstep) / 100.0;
+	const double c = double(acceleration) / 100.0;
+	const double ce = e - 1.0;
+
+	// First check intersection with bounding box
+	double a, b;
+	if (!field->GetBox().Intersect(ray, a, b))
+		return false;
+
+	t = a;
+	s = 0;
+	const double tolerance = options.tolerance;
+	const double minStep = options.minStep;
+
+	// Start with a huge step (segment tracing only), or up to the hinted depth
+	double ts = (hint > 0.0 && hint > a && hint < b) ? (hint - a) : (b - a);
+
+	// Safe marching distance used in the previous step 
+	double te = 0.0;
+
+	// Last sample outside, for refining the intersection
+	double tOut = t;
+	double iOut = 0.0;
+	bool outside = false;
+	while (t < b)
+	{
+		if (instrumentation >= StepCount)
+			s++;
+		double i = field->Intensity(ray(t));
+
+		// Got inside
+		if (i > 0.0)
+		{
+			if (tolerance > 0.0 && outside && tOut < t)
+				t = Refine<instrumentation>(field, ray, tOut, iOut, t, i, tolerance, s);
+			return true;
+		}
+		tOut = t;
+		iOut = i;
+		outside = true;
+
+		// Safe stepping distance
+		double tk;
+		if (policy != GlobalBound)
+		{
+			double kk = field->K(Segment(ray(t), ray(t + ts)), policy == DirectionalBound);
+			tk = Math::Min(fabs(i) / kk, ts);
+		}
+		else
+			tk = fabs(i) / k;
+
+		// We moved too far and the Lipschitz check fails: we need to move backward
+		if (overstep > 100 && tk < ce * te)
+		{
+			t -= ce * te;
+			te = 0.0;
+		}
+		// Over-estimated stepping distance is fine, so move on to the next position with over-estimated stepping distance
+		else
+		{
+			te = tk;
+			t += Math::Max(tk * e, minStep);
+		}
+
+		// Try to increase step bound
+		if (policy != GlobalBound)
+			ts = tk * c;
+	}
+	return false;
+}
+
+/*!
+\brief Any-hit segment tracing for secondary rays, such as shadow or ambient occlusion rays.
+
+The tracer only tells whether the surface is crossed before a maximum depth: it stops at the first
+positive intensity, never steps backward and does not compute the intersection depth.
+\param field implicit field
+\param ray the ray
+\param tmax maximum depth
+\param s returned step count
+\tparam acceleration acceleration factor in hundredths, defining the stepping distance increase factor of segment tracing
+\tparam instrumentation level of instrumentation
+\return true if the ray hits the surface before tmax.
+*/
+template<int acceleration, Instrumentation instrumentation, typename Field>
+inline bool TraceAnyHit(const Field* field, const Ray& ray, double tmax, int& s)
+{
+	const double c = double(acceleration) / 100.0;
+	s = 0;
+
+	double a, b;
+	if (!field->GetBox().Intersect(ray, a, b))
+		return false;
+	double t = Math::Max(a, 0.0);
+	b = Math::Min(b, tmax);
+
+	double ts = b - t;
+	while (t < b)
+	{
+		if (instrumentation >= StepCount)
+			s++;
+		double i = field->Intensity(ray(t));
+		if (i > 0.0)
+			return true;
+		double kk = field->K(Segment(ray(t), ray(t + ts)));
+		double tk = Math::Min(fabs(i) / kk, ts);
+		t += Math::Max(tk, Epsilon());
+		ts = tk * c;
+	}
+	return false;
+}
+
+/*!
+\brief Segment tracing skipping the empty cells of a SpaceOctree.
+
+Before evaluating the field, the sample is located in the octree: samples in empty cells directly
+jump to the exit of the cell, so that only cells that may be crossed by the surface are marched.
+Intersections are refined and steps are bounded below by the options, as in Trace(); empty cells hold
+no surface, so the last sample outside still brackets the intersection after a jump.
+\param field implicit field
+\param octree classification of the space of the field
+\param ray the ray
+\param options refinement tolerance and minimum marching step
+\param t returned intersection depth
+\param s returned step count, jumps across empty cells are not counted
+\tparam acceleration acceleration factor in hundredths, defining the stepping distance increase factor of segment tracing
+\tparam instrumentation level of instrumentation
+\return true of intersection occured, false otherwise.
+*/
+template<int acceleration, Instrumentation instrumentation, typename Field>
+inline bool TraceOctree(const Field* field, const SpaceOctree* octree, const Ray& ray, const TraceOptions& options, double& t, int& s)
+{
+	const double c = double(acceleration) / 100.0;
+	s = 0;
+
+	double a, b;
+	if (!field->GetBox().Intersect(ray, a, b))
+		return false;
+	t = a;
+
+	double ts = b - a;
+
+	// Last sample outside, for refining the intersection
+	double tOut = t;
+	double iOut = 0.0;
+	bool outside = false;
+
+	// Exit of the current non empty leaf, the octree is only queried again past it
+	double exit = t;
+	while (t < b)
+	{
+		if (t >= exit && octree->Locate(ray, t, exit) == EmptySpace)
+		{
+			// Samples exactly on the exit face would be located in the same cell again
+			t = Math::Max(exit, t) + 1e-6;
+			continue;
+		}
+
+		if (instrumentation >= StepCount)
+			s++;
+		double i = field->Intensity(ray(t));
+		if (i > 0.0)
+		{
+			if (options.tolerance > 0.0 && outside && tOut < t)
+				t = Refine<instrumentation>(field, ray, tOut, iOut, t, i, options.tolerance, s);
+			return true;
+		}
+		tOut = t;
+		iOut = i;
+		outside = true;
+		double kk = field->K(Segment(ray(t), ray(t + ts)));
+		double tk = Math::Min(fabs(i) / kk, ts);
+		t += Math::Max(tk, options.minStep);
+		ts = tk * c;
+	}
+	return false;
+}
+
+/*!
+\brief Result of tracing the ray of a pixel.
+*/
+struct PixelSample
+{
+	bool hit = false;			//!< True if the ray hit the surface
+	double t = 0.0;				//!< Intersection depth
+	Vector normal = Vector(0);	//!< Surface normal at the intersection
+	Vector color = Vector(0);	//!< Shaded color
+	int steps = 0;				//!< Number of field queries along the ray
+};
+
+/*!
+\brief Trace the ray of a pixel and shade the intersection.
+\param field implicit field
+\param ray the ray going through the pixel
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param options tracer options, see Trace()
+\param hint expected intersection depth, see Trace()
+*/
+template<StepPolicy policy, int overstep, int acceleration, Instrumentation instrumentation, typename Field>
+inline PixelSample TracePixel(const Field* field, const Ray& ray, double k, const TraceOptions& options, double hint = 0.0)
+{
+	PixelSample sample;
+
+	// Compute intersection
+	sample.hit = Trace<policy, overstep, acceleration, instrumentation>(field, ray, k, options, sample.t, sample.steps, hint);
+
+	// Compute pixel color
+	if (sample.hit)
+	{
+		ProfileScope scope("Shade");
+
+		// Hit position and normal
+		Vector hitPosition = ray(sample.t);
+		sample.normal = -Normalized(field->Gradient(hitPosition));
+
+		// Diffuse lighting
+		double NDotL = Math::Max(sample.normal * sunDir, 0.1);
+		sample.color = Vector(255 * NDotL, 0, 0);
+	}
+	return sample;
+}
+
+/*!
+\brief Compute a pixel color.
+\param field implicit field
+\param ray the ray going through the pixel
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param options tracer options, see Trace()
+\param color returned color for the pixel
+\param cost returned cost (as a RGBA color) for the pixel
+*/
+template<StepPolicy policy, int overstep, int acceleration, Instrumentation instrumentation, typename Field>
+inline void PixelColor(const Field* field, const Ray& ray, double k, const TraceOptions& options, Vector& color, Vector& cost)
+{
+	PixelSample sample = TracePixel<policy, overstep, acceleration, instrumentation>(field, ray, k, options);
+	color = sample.color;
+	cost = Vector(0);
+
+	// Compute cost
+	// Unfair comparison (for us), but we can't see anything on the cost image using state of the art methods
+	if (instrumentation >= StepCount)
+	{
+		const double div = (policy != GlobalBound) ? 512 : 16384;
+		double c = Math::Min(double(sample.steps) / div, 1.0);
+		cost = Vector(0, c * 255.0, 0);
+	}
+}
+
+/*!
+\brief Check whether two samples of a progressive render disagree, so that the pixels between them should be traced.
+\param a, b samples
+*/
+inline bool Disagree(const PixelSample& a, const PixelSample& b)
+{
+	const double depthTolerance = 0.02;	// Relative depth difference
+	const double normalTolerance = 0.95;	// Cosine of the angle between normals
+	if (a.hit != b.hit)
+		return true;
+	if (!a.hit)
+		return false;
+	return fabs(a.t - b.t) > depthTolerance * Math::Min(a.t, b.t) || a.normal * b.normal < normalTolerance;
+}
+
+/*!
+\brief Render a whole frame with a given tracer configuration.
+\param field implicit field
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param pixels returned colors
+\param pixelsCost returned costs
+*/
+template<StepPolicy policy, int overstep, int acceleration, Instrumentation instrumentation, typename Field>
+void RenderFrame(const Field* field, double k, Vector** pixels, Vector** pixelsCost)
+{
+	ProfileScope scope("Render frame");
+	const Camera camera(settings.camera, settings.width, settings.height);
+	const int tileWidth = 16;
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int x = 0; x < settings.width; x += tileWidth)
+	{
+		ProfileScope tile("Render tile");
+		for (int i = x; i < min(x + tileWidth, settings.width); i++)
+		{
+			for (int j = 0; j < settings.height; j++)
+			{
+				Vector col = Vector(0);
+				Vector cost = Vector(0);
+				PixelColor<policy, overstep, acceleration, instrumentation>(field, camera.PixelRay(i, j), k, settings.tracing, col, cost);
+				pixels[i][j] = col;
+				pixelsCost[i][j] = cost;
+			}
+		}
+	}
+}
+
+/*!
+\brief Render a whole frame, selecting the tracer configuration once for the frame.
+\param field implicit field
+\param method raytracing method
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param pixels returned colors
+\param pixelsCost returned costs
+*/
+template<typename Field>
+void RenderFrame(const Field* field, RayTraceMethod method, double k, Vector** pixels, Vector** pixelsCost)
+{
+	switch (method)
+	{
+	case SphereTracing:
+		RenderFrame<GlobalBound, 100, 100, StepCount>(field, k, pixels, pixelsCost);
+		break;
+	case EnhancedSphereTracing:
+		RenderFrame<GlobalBound, 125, 100, StepCount>(field, k, pixels, pixelsCost);
+		break;
+	case SegmentTracing:
+		if (settings.directionalBound)
+			RenderFrame<DirectionalBound, 100, 150, StepCount>(field, k, pixels, pixelsCost);
+		else
+			RenderFrame<SegmentBound, 100, 150, StepCount>(field, k, pixels, pixelsCost);
+		break;
+	default:
+		break;
+	};
+}
+
+bool WriteToFile(const char* path, Vector** pixels);
+bool WriteToFile(const char* path, const std::vector<Vector>& pixels, int width, int height);
@@ -0,0 +1,95 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreeanalyzer.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Analyze the traversal of the hierarchy of the tree by the queries of a segment traced frame.
+
+The frame is rendered with the analyzer as the field, and compared to the frame rendered with the tree, which should be
+identical. Totals and per level statistics of the Intensity and K(Segment) queries are printed: nodes reached per query,
+share of the reached nodes culled by their box, and share of those passing their box without finding any contribution.
+The leaves wasting the most primitive evaluations on useless visits are listed, the counters of every node are written to accesses.csv, and
+icicle plots of the accesses are written to heatmap_intensity.ppm and heatmap_segment.ppm.
+\param pixels, pixelsCost frame buffers
+\return false if the frame rendered with the analyzer differs from the frame rendered with the tree.
+*/
+bool AnalyzeHierarchy(Vector** pixels, Vector** pixelsCost)
+{
+	BlobTreeAnalyzer analyzer(*tree);
+	RenderFrame(tree, RayTraceMethod::SegmentTracing, tree->K(), pixels, pixelsCost);
+	std::vector<Vector> reference(size_t(settings.width) * settings.height);
+	for (int x = 0; x < settings.width; x++)
+		for (int y = 0; y < settings.height; y++)
+			reference[size_t(y) * settings.width + x] = pixels[x][y];
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	RenderFrame(&analyzer, RayTraceMethod::SegmentTracing, tree->K(), pixels, pixelsCost);
+	double time = Seconds(begin, std::chrono::steady_clock::now());
+	int differ = 0;
+	for (int x = 0; x < settings.width; x++)
+		for (int y = 0; y < settings.height; y++)
+			differ += reference[size_t(y) * settings.width + x] != pixels[x][y];
+	std::cout << "Analyzed frame: " << int(1000.0 * time) << "ms, leaf size " << settings.leafSize << ", " << (settings.directionalBound ? "directional" : "sum")
+		<< " bound, " << differ << " pixels differ from the tree" << std::endl;
+
+	// Totals, queries are counted at the root
+	const char* names[2] = { "Intensity", "K(Segment)" };
+	std::vector<LevelAccess> levels = analyzer.Levels();
+	std::cout << std::setw(12) << "Query" << std::setw(12) << "Count" << std::setw(12) << "Nodes/query" << std::setw(12) << "Prims/query" << std::setw(10) << "Culled" << std::setw(10) << "Useless" << std::endl;
+	for (int q = 0; q < 2; q++)
+	{
+		LevelAccess total;
+		for (const LevelAccess& level : levels)
+		{
+			total.Add(level);
+			total.primitives[q] += level.primitives[q];
+		}
+		double queries = double(std::max(levels[0].reached[q], 1LL));
+		std::cout << std::setw(12) << names[q] << std::setw(12) << levels[0].reached[q] << std::setw(12) << std::setprecision(3) << double(total.reached[q]) / queries
+			<< std::setw(12) << double(total.primitives[q]) / queries << std::setw(9) << 100.0 * double(total.culled[q]) / double(std::max(total.reached[q], 1LL)) << "%"
+			<< std::setw(9) << 100.0 * double(total.useless[q]) / double(std::max(total.reached[q], 1LL)) << "%" << std::endl;
+	}
+
+	// Levels, shares are relative to the queries reaching the level
+	std::cout << std::endl << std::setw(6) << "Level" << std::setw(8) << "Nodes" << std::setw(8) << "Leaves";
+	for (int q = 0; q < 2; q++)
+		std::cout << std::setw(14) << names[q] << std::setw(9) << "Culled" << std::setw(9) << "Useless";
+	std::cout << std::endl;
+	for (int l = 0; l < int(levels.size()); l++)
+	{
+		const LevelAccess& level = levels[l];
+		std::cout << std::setw(6) << l << std::setw(8) << level.nodes << std::setw(8) << level.leaves;
+		for (int q = 0; q < 2; q++)
+			std::cout << std::setw(14) << level.reached[q] << std::setw(8) << std::setprecision(3) << 100.0 * double(level.culled[q]) / double(std::max(level.reached[q], 1LL)) << "%"
+				<< std::setw(8) << 100.0 * double(level.useless[q]) / double(std::max(level.reached[q], 1LL)) << "%";
+		std::cout << std::endl;
+	}
+
+	// Leaves wasting the most primitive evaluations
+	const int worst = 10;
+	std::vector<NodeAccess> accesses = analyzer.Accesses();
+	std::vector<int> order;
+	for (int i = 0; i < analyzer.Size(); i++)
+		if (analyzer.Leaf(i))
+			order.push_back(i);
+	auto wasted = [&](int i) { return (accesses[i].useless[0] + accesses[i].useless[1]) * analyzer.Primitives(i); };
+	std::partial_sort(order.begin(), order.begin() + min(worst, int(order.size())), order.end(), [&](int a, int b) { return wasted(a) > wasted(b); });
+	std::cout << std::endl << std::setw(8) << "Leaf" << std::setw(7) << "Depth" << std::setw(12) << "Primitives" << std::setw(12) << "Useless" << std::setw(14) << "Evaluations" << std::endl;
+	for (int n = 0; n < min(worst, int(order.size())); n++)
+		std::cout << std::setw(8) << order[n] << std::setw(7) << analyzer.Depth(order[n]) << std::setw(12) << analyzer.Primitives(order[n])
+			<< std::setw(12) << accesses[order[n]].useless[0] + accesses[order[n]].useless[1] << std::setw(14) << wasted(order[n]) << std::endl;
+
+	analyzer.WriteAccesses("./accesses.csv");
+	const char* paths[2] = { "./heatmap_intensity.ppm", "./heatmap_segment.ppm" };
+	for (int q = 0; q < 2; q++)
+	{
+		std::vector<Vector> image;
+		int height = 0;
+		analyzer.Heatmap(q, 1024, 8, image, height);
+		if (!WriteToFile(paths[q], image, 1024, height))
+			std::cout << "WriteToFile Error - failed to write heatmap to disk" << std::endl;
+	}
+	return differ == 0;
+}
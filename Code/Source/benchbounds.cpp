@@ -0,0 +1,102 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Benchmark the directional lipschitz bound of segment tracing against the sum of the bounds of the primitives.
+
+Random segments start from points outside the surface, toward random directions: the mean ratio of the
+directional bound to the sum and the time of both queries are reported. The frame is then rendered with
+both bounds, reporting field queries, time and the hits that differ.
+\param field implicit field
+\param name name of the hierarchy
+*/
+template<typename Field>
+void BenchmarkBounds(const Field* field, const char* name)
+{
+	const int count = 100000;
+	Box box = field->GetBox();
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Segment> segments;
+	while (int(segments.size()) < count)
+	{
+		Vector a = box[0] + Vector(unit(gen), unit(gen), unit(gen)).Scale(box.Diagonal());
+		if (field->Intensity(a) > 0.0)
+			continue;
+		Vector d = Normalized(Vector(unit(gen) - 0.5, unit(gen) - 0.5, unit(gen) - 0.5));
+		segments.push_back(Segment(a, a + d * 10.0 * unit(gen)));
+	}
+	double ratio = 0.0;
+	int bounded = 0;
+	double times[2];
+	for (int j = 0; j < 2; j++)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::vector<double> k(count);
+		for (int i = 0; i < count; i++)
+			k[i] = field->K(segments[i], j == 1);
+		times[j] = Seconds(begin, std::chrono::steady_clock::now());
+		for (int i = 0; i < count && j == 1; i++)
+		{
+			double sum = field->K(segments[i]);
+			if (sum > 0.0)
+			{
+				ratio += k[i] / sum;
+				bounded++;
+			}
+		}
+	}
+
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	std::vector<PixelSample> samples[2];
+	long long steps[2] = { 0, 0 };
+	double renderTimes[2];
+	for (int j = 0; j < 2; j++)
+	{
+		samples[j].resize(size_t(w) * h);
+		long long s = 0;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: s)
+		for (int x = 0; x < w; x++)
+		{
+			for (int y = 0; y < h; y++)
+			{
+				PixelSample& sample = samples[j][size_t(y) * w + x];
+				if (j == 0)
+					sample = TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), 0.0, settings.tracing);
+				else
+					sample = TracePixel<DirectionalBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), 0.0, settings.tracing);
+				s += sample.steps;
+			}
+		}
+		renderTimes[j] = Seconds(begin, std::chrono::steady_clock::now());
+		steps[j] = s;
+	}
+	int differ = 0;
+	for (size_t i = 0; i < samples[0].size(); i++)
+		if (samples[0][i].hit != samples[1][i].hit || (samples[0][i].hit && fabs(samples[0][i].t - samples[1][i].t) > 0.01))
+			differ++;
+
+	std::cout << name << ": directional bound " << std::setprecision(3) << (bounded > 0 ? ratio / bounded : 0.0) << " of the sum on average" << std::endl;
+	std::cout << std::setw(14) << "Bound" << std::setw(10) << "K(ms)" << std::setw(12) << "Steps" << std::setw(12) << "Render(ms)" << std::endl;
+	const char* names[2] = { "Sum", "Directional" };
+	for (int j = 0; j < 2; j++)
+		std::cout << std::setw(14) << names[j] << std::setw(10) << int(1000.0 * times[j]) << std::setw(12) << steps[j] << std::setw(12) << int(1000.0 * renderTimes[j]) << std::endl;
+	std::cout << "Hits that differ: " << differ << std::endl << std::endl;
+}
+
+/*!
+\brief Benchmark the directional lipschitz bound on the binary tree and on the wide hierarchy of the scene.
+*/
+void BenchmarkBounds()
+{
+	BenchmarkBounds(tree, "Binary tree");
+	BlobTreeWide<4> wide(*tree);
+	BenchmarkBounds(&wide, "Wide hierarchy");
+}
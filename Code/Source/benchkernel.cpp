@@ -0,0 +1,69 @@
+#include "modes.h"
+#include "tracing.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Benchmark the lipschitz bound of ranges of point primitives with precomputed constants against the reference.
+
+Random segments start inside the box of a random primitive and are tested against the range of its neighbors in the
+primitive buffer, which are close in space. The reference evaluates BlobTreePoint::K() for every primitive overlapping
+the segment. Time, bounds that differ bitwise and the largest relative difference are reported for both bounds.
+Both bounds should be bitwise identical, which requires building without contraction of floating point operations.
+\return false if some bounds differ.
+*/
+bool BenchmarkKernel()
+{
+	const int count = 1000000;
+	const int range = 16;
+	const PointBuffer& points = tree->GetPoints();
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Segment> segments(count);
+	std::vector<int> first(count);
+	for (int i = 0; i < count; i++)
+	{
+		int j = std::uniform_int_distribution<int>(0, points.Size() - 1)(gen);
+		first[i] = Math::Clamp(j - range / 2, 0, std::max(points.Size() - range, 0));
+		Vector a = points.Center(j) + points.r[j] * Vector(2.0 * unit(gen) - 1.0, 2.0 * unit(gen) - 1.0, 2.0 * unit(gen) - 1.0);
+		Vector d = Normalized(Vector(unit(gen) - 0.5, unit(gen) - 0.5, unit(gen) - 0.5));
+		segments[i] = Segment(a, a + d * 2.0 * points.r[j] * unit(gen));
+	}
+
+	std::cout << std::setw(14) << "Bound" << std::setw(16) << "Reference(ms)" << std::setw(16) << "Precomputed(ms)" << std::setw(10) << "Differ" << std::setw(14) << "Max relative" << std::endl;
+	const char* names[2] = { "Sum", "Directional" };
+	bool identical = true;
+	for (int j = 0; j < 2; j++)
+	{
+		std::vector<double> k[2] = { std::vector<double>(count), std::vector<double>(count) };
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			int end = std::min(first[i] + range, points.Size());
+			for (int p = first[i]; p < end; p++)
+				if (segments[i].Intersect(points.GetBox(p)))
+					k[0][i] += BlobTreePoint::K(points.Center(p), points.r[p], points.e[p], segments[i], j == 1);
+		}
+		double reference = Seconds(begin, std::chrono::steady_clock::now());
+		begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+			k[1][i] = points.K(first[i], std::min(first[i] + range, points.Size()), SegmentQuery(segments[i]), j == 1);
+		double precomputed = Seconds(begin, std::chrono::steady_clock::now());
+
+		int differ = 0;
+		double relative = 0.0;
+		for (int i = 0; i < count; i++)
+		{
+			if (k[0][i] == k[1][i])
+				continue;
+			differ++;
+			relative = Math::Max(relative, fabs(k[1][i] - k[0][i]) / Math::Max(fabs(k[0][i]), 1e-300));
+		}
+		std::cout << std::setw(14) << names[j] << std::setw(16) << int(1000.0 * reference) << std::setw(16) << int(1000.0 * precomputed) << std::setw(10) << differ << std::setw(14) << std::setprecision(3) << relative << std::endl;
+		identical = identical && differ == 0;
+	}
+	if (!identical)
+		std::cout << "Precomputed bounds differ from the reference, check that floating point contraction is disabled" << std::endl;
+	return identical;
+}
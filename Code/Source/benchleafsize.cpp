@@ -0,0 +1,93 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include "blobtreequantized.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Time the same set of Intensity and K(Segment) queries and a segment traced frame on a hierarchy, and print a row of results.
+\param field implicit field
+\param leaf maximum number of primitives per leaf
+\param name name of the hierarchy
+\param points, segments queries
+\param pixels, pixelsCost frame buffers used for the render
+*/
+template<typename Field>
+void BenchmarkField(const Field* field, int leaf, const char* name, const std::vector<Vector>& points, const std::vector<Segment>& segments, Vector** pixels, Vector** pixelsCost)
+{
+	BlobTreeStats stats = field->Stats();
+
+	double sum = 0.0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < int(points.size()); i++)
+		sum += field->Intensity(points[i]);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	long long intensityTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+	begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < int(segments.size()); i++)
+		sum += field->K(segments[i]);
+	end = std::chrono::steady_clock::now();
+	long long kTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+	begin = std::chrono::steady_clock::now();
+	RenderFrame(field, RayTraceMethod::SegmentTracing, field->K(), pixels, pixelsCost);
+	end = std::chrono::steady_clock::now();
+	long long renderTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+	std::cout << std::setw(6) << leaf << std::setw(11) << name << std::setw(10) << stats.nodes << std::setw(12) << stats.memory / 1024 << std::setw(12) << stats.memory / stats.primitives << std::setw(10) << stats.maxDepth
+		<< std::setw(10) << std::setprecision(3) << stats.AverageDepth() << std::setw(14) << intensityTime << std::setw(8) << kTime << std::setw(12) << renderTime
+		<< "  (checksum " << std::setprecision(9) << sum << ")" << std::endl;
+}
+
+/*!
+\brief Benchmark the hierarchy of the scene for several leaf sizes, binary, wide and compressed.
+
+Every hierarchy answers the same set of random Intensity and K(Segment) queries, and renders
+one frame using segment tracing. Node count, memory footprint and depth are reported as well.
+\param pixels, pixelsCost frame buffers used for the render
+*/
+void BenchmarkLeafSize(Vector** pixels, Vector** pixelsCost)
+{
+	const int leafSizes[] = { 1, 2, 4, 8, 16, 32 };
+	const int pointCount = 1000000;
+	const int segmentCount = 200000;
+
+	// Same queries for all hierarchies, uniformly distributed in the bounding box of the scene
+	Box box = tree->GetBox();
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	auto randomPoint = [&]() { return box[0] + Vector(unit(gen), unit(gen), unit(gen)).Scale(box.Diagonal()); };
+	std::vector<Vector> points(pointCount);
+	for (int i = 0; i < pointCount; i++)
+		points[i] = randomPoint();
+	std::vector<Segment> segments(segmentCount);
+	for (int i = 0; i < segmentCount; i++)
+	{
+		Vector a = randomPoint();
+		Vector d = Normalized(Vector(unit(gen), unit(gen), unit(gen)) - Vector(0.5));
+		segments[i] = Segment(a, a + d * 10.0 * unit(gen));
+	}
+
+	std::cout << std::setw(6) << "Leaf" << std::setw(11) << "Hierarchy" << std::setw(10) << "Nodes" << std::setw(12) << "Memory(KB)" << std::setw(12) << "Bytes/prim" << std::setw(10) << "MaxDepth" << std::setw(10) << "AvgDepth"
+		<< std::setw(14) << "Intensity(ms)" << std::setw(8) << "K(ms)" << std::setw(12) << "Render(ms)" << std::endl;
+	for (int leaf : leafSizes)
+	{
+		BlobTree binary(settings.scene.c_str(), leaf);
+		BenchmarkField(&binary, leaf, "binary", points, segments, pixels, pixelsCost);
+		BlobTreeWide<4> wide4(binary);
+		BenchmarkField(&wide4, leaf, "wide4", points, segments, pixels, pixelsCost);
+		BlobTreeQuantized<4, uint16_t> wide4q16(wide4);
+		BenchmarkField(&wide4q16, leaf, "wide4-q16", points, segments, pixels, pixelsCost);
+		BlobTreeQuantized<4, uint8_t> wide4q8(wide4);
+		BenchmarkField(&wide4q8, leaf, "wide4-q8", points, segments, pixels, pixelsCost);
+		BlobTreeWide<8> wide8(binary);
+		BenchmarkField(&wide8, leaf, "wide8", points, segments, pixels, pixelsCost);
+		BlobTreeQuantized<8, uint16_t> wide8q16(wide8);
+		BenchmarkField(&wide8q16, leaf, "wide8-q16", points, segments, pixels, pixelsCost);
+		BlobTreeQuantized<8, uint8_t> wide8q8(wide8);
+		BenchmarkField(&wide8q8, leaf, "wide8-q8", points, segments, pixels, pixelsCost);
+	}
+}
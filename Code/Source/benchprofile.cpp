@@ -0,0 +1,60 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Measure the overhead of the profiler on scopes and on a segment traced frame.
+
+An empty loop and loops of scopes with the profiler disabled and enabled give the cost of a scope. The frame is then
+rendered alternately with the profiler disabled and enabled, keeping the best time of each. The events recorded by
+the benchmark are cleared from the trace.
+\param pixels, pixelsCost frame buffers
+*/
+void BenchmarkProfiler(Vector** pixels, Vector** pixelsCost)
+{
+	const bool enabled = Profiler::Enabled();
+	const int n = 1 << 24;
+	volatile int sink = 0;
+	double scope[3];
+	for (int e = 0; e < 3; e++)
+	{
+		Profiler::Enable(e == 2);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		if (e == 0)
+		{
+			for (int i = 0; i < n; i++)
+				sink = i;
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+			{
+				ProfileScope s("Empty scope");
+				sink = i;
+			}
+		}
+		scope[e] = 1e9 * Seconds(begin, std::chrono::steady_clock::now()) / double(n);
+		if (sink != n - 1)
+			std::cout << "Loop of scopes was not run completely" << std::endl;
+	}
+	std::cout << "Scope: " << std::setprecision(3) << scope[1] - scope[0] << "ns disabled, " << scope[2] - scope[0] << "ns enabled" << std::endl;
+
+	const int rounds = 5;
+	BlobTreeWide<4> wide(*tree);
+	double best[2] = { Math::Infinity, Math::Infinity };
+	Profiler::Clear();
+	for (int r = 0; r < 2 * rounds; r++)
+	{
+		Profiler::Enable(r % 2 == 1);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		RenderFrame(&wide, RayTraceMethod::SegmentTracing, wide.K(), pixels, pixelsCost);
+		best[r % 2] = Math::Min(best[r % 2], Seconds(begin, std::chrono::steady_clock::now()));
+	}
+	uint64_t events = Profiler::Recorded() / rounds;
+	std::cout << "Frame: " << int(1000.0 * best[0]) << "ms disabled, " << int(1000.0 * best[1]) << "ms enabled, " << events << " events, overhead "
+		<< std::setprecision(3) << 100.0 * (best[1] - best[0]) / best[0] << "%" << std::endl;
+	Profiler::Clear();
+	Profiler::Enable(enabled);
+}
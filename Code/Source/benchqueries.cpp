@@ -0,0 +1,66 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Benchmark the batch point queries of the tree against single point queries.
+
+Random points are uniformly distributed in the bounding box of the scene, while coherent points
+are the nodes of a regular grid enumerated in scan order. Batch results are checked against single queries.
+*/
+void BenchmarkQueries()
+{
+	const int n = 100;
+	const int count = n * n * n;
+	Box box = tree->GetBox();
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Vector> sets[2];
+	sets[0].resize(count);
+	sets[1].resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		sets[0][i] = box[0] + Vector(unit(gen), unit(gen), unit(gen)).Scale(box.Diagonal());
+		sets[1][i] = box[0] + Vector(double(i % n) + 0.5, double((i / n) % n) + 0.5, double(i / (n * n)) + 0.5).Scale(box.Diagonal()) / double(n);
+	}
+
+	const char* names[2] = { "random", "coherent" };
+	std::cout << std::setw(10) << "Points" << std::setw(10) << "Query" << std::setw(18) << "Single(Mq/s)" << std::setw(18) << "Batch(Mq/s)" << std::setw(12) << "Max error" << std::endl;
+	for (int j = 0; j < 2; j++)
+	{
+		const std::vector<Vector>& pts = sets[j];
+
+		// Intensity
+		std::vector<double> single(count), batch;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+			single[i] = tree->Intensity(pts[i]);
+		double singleTime = Seconds(begin, std::chrono::steady_clock::now());
+		begin = std::chrono::steady_clock::now();
+		tree->Intensity(pts, batch);
+		double batchTime = Seconds(begin, std::chrono::steady_clock::now());
+		double error = 0.0;
+		for (int i = 0; i < count; i++)
+			error = Math::Max(error, fabs(single[i] - batch[i]));
+		std::cout << std::setw(10) << names[j] << std::setw(10) << "Intensity" << std::setw(18) << std::setprecision(3) << 1e-6 * count / singleTime
+			<< std::setw(18) << 1e-6 * count / batchTime << std::setw(12) << error << std::endl;
+
+		// Gradient
+		std::vector<Vector> singleGradient(count), batchGradient;
+		begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+			singleGradient[i] = tree->Gradient(pts[i]);
+		singleTime = Seconds(begin, std::chrono::steady_clock::now());
+		begin = std::chrono::steady_clock::now();
+		tree->Gradient(pts, batchGradient);
+		batchTime = Seconds(begin, std::chrono::steady_clock::now());
+		error = 0.0;
+		for (int i = 0; i < count; i++)
+			error = Math::Max(error, Norm(singleGradient[i] - batchGradient[i]));
+		std::cout << std::setw(10) << names[j] << std::setw(10) << "Gradient" << std::setw(18) << 1e-6 * count / singleTime
+			<< std::setw(18) << 1e-6 * count / batchTime << std::setw(12) << error << std::endl;
+	}
+}
@@ -0,0 +1,83 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Benchmark the refinement of intersections with segment tracing.
+
+Every configuration of refinement tolerance and minimum marching step renders the same frame. Field queries,
+including those of the refinement, time, and the mean distance of the hits to the surface, estimated as
+|f(p)|/|grad f(p)|, are reported, as well as the hits that differ from the first configuration.
+Refined hits should lie within the tolerance of the surface on average, and refining should not change which
+pixels hit the surface when the minimum step is the same as the first configuration.
+\param field implicit field
+\return false if refined hits are farther from the surface than the tolerance, or if refining changed the hits.
+*/
+template<typename Field>
+bool BenchmarkRefine(const Field* field)
+{
+	const double configurations[][2] = { { 0.0, 1e-3 }, { 1e-4, 1e-3 }, { 1e-4, 1e-2 }, { 1e-4, 5e-2 }, { 1e-4, 0.2 } };
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	std::vector<PixelSample> reference;
+	bool valid = true;
+
+	std::cout << std::setw(11) << "Tolerance" << std::setw(10) << "MinStep" << std::setw(12) << "Queries" << std::setw(10) << "Time(ms)" << std::setw(14) << "Distance" << std::setw(12) << "Mismatches" << std::endl;
+	for (const double* c : configurations)
+	{
+		TraceOptions options;
+		options.tolerance = c[0];
+		options.minStep = c[1];
+		std::vector<PixelSample> samples(size_t(w) * h);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16)
+		for (int x = 0; x < w; x++)
+			for (int y = 0; y < h; y++)
+				samples[size_t(y) * w + x] = TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), field->K(), options);
+		double time = Seconds(begin, std::chrono::steady_clock::now());
+
+		long long queries = 0;
+		double distance = 0.0;
+		int hits = 0;
+		int mismatches = 0;
+		for (int x = 0; x < w; x++)
+		{
+			for (int y = 0; y < h; y++)
+			{
+				const PixelSample& sample = samples[size_t(y) * w + x];
+				queries += sample.steps;
+				if (!reference.empty() && reference[size_t(y) * w + x].hit != sample.hit)
+					mismatches++;
+				if (!sample.hit)
+					continue;
+				Vector p = camera.PixelRay(x, y)(sample.t);
+				distance += fabs(field->Intensity(p)) / Norm(field->Gradient(p));
+				hits++;
+			}
+		}
+		if (reference.empty())
+			reference = samples;
+		std::cout << std::setw(11) << c[0] << std::setw(10) << c[1] << std::setw(12) << queries << std::setw(10) << int(1000.0 * time)
+			<< std::setw(14) << std::setprecision(3) << (hits > 0 ? distance / hits : 0.0) << std::setw(12) << mismatches << std::endl;
+		if (c[0] > 0.0 && hits > 0 && distance / hits > c[0])
+			valid = false;
+		if (c[1] == configurations[0][1] && mismatches > 0)
+			valid = false;
+	}
+	if (!valid)
+		std::cout << "Refined hits are not within the tolerance of the surface, or refining changed the hits" << std::endl;
+	return valid;
+}
+
+/*!
+\brief Benchmark the refinement of intersections on the wide hierarchy of the scene.
+\return false if refined hits are farther from the surface than the tolerance, or if refining changed the hits.
+*/
+bool BenchmarkRefine()
+{
+	BlobTreeWide<4> wide(*tree);
+	return BenchmarkRefine(&wide);
+}
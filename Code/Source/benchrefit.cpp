@@ -0,0 +1,67 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Benchmark the update of the hierarchy for an animated scene.
+
+Every particle of the scene drifts along its own random direction. One tree is updated by refitting
+and rebuilding overlapping sub-trees, the other one is rebuilt from scratch at every frame. Update
+time, hierarchy quality and the time for rendering a frame with segment tracing are compared.
+\param pixels, pixelsCost frame buffers used for the render
+*/
+void BenchmarkRefit(Vector** pixels, Vector** pixelsCost)
+{
+	const int frameCount = 10;
+
+	// Initial centers, in the order of the file
+	const PointBuffer& pb = tree->GetPoints();
+	std::vector<Vector> rest(pb.Size());
+	for (int i = 0; i < pb.Size(); i++)
+		rest[pb.id[i]] = pb.Center(i);
+
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Vector> velocity(rest.size());
+	for (int i = 0; i < int(rest.size()); i++)
+		velocity[i] = Normalized(Vector(unit(gen), unit(gen), unit(gen)) - Vector(0.5)) * unit(gen);
+
+	BlobTree refitted(settings.scene.c_str(), settings.leafSize);
+	BlobTree rebuilt(settings.scene.c_str(), settings.leafSize);
+	std::vector<Vector> centers(rest.size());
+	std::cout << std::setw(6) << "Frame" << std::setw(12) << "Update(us)" << std::setw(10) << "Rebuilt" << std::setw(10) << "Overlap"
+		<< std::setw(13) << "Rebuild(us)" << std::setw(10) << "Overlap" << std::setw(18) << "Render update(ms)" << std::setw(19) << "Render rebuild(ms)" << std::endl;
+	for (int f = 1; f <= frameCount; f++)
+	{
+		for (int i = 0; i < int(rest.size()); i++)
+			centers[i] = rest[i] + velocity[i] * double(f);
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		int count = refitted.Update(centers);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		long long updateTime = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+		begin = std::chrono::steady_clock::now();
+		rebuilt.Update(centers, Math::Infinity);
+		rebuilt.Rebuild();
+		end = std::chrono::steady_clock::now();
+		long long rebuildTime = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+		long long renderTime[2];
+		const BlobTree* trees[2] = { &refitted, &rebuilt };
+		for (int j = 0; j < 2; j++)
+		{
+			BlobTreeWide<4> wide(*trees[j]);
+			begin = std::chrono::steady_clock::now();
+			RenderFrame(&wide, RayTraceMethod::SegmentTracing, wide.K(), pixels, pixelsCost);
+			end = std::chrono::steady_clock::now();
+			renderTime[j] = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+		}
+
+		std::cout << std::setw(6) << f << std::setw(12) << updateTime << std::setw(10) << count << std::setw(10) << std::setprecision(3) << refitted.Stats().AverageOverlap()
+			<< std::setw(13) << rebuildTime << std::setw(10) << rebuilt.Stats().AverageOverlap() << std::setw(18) << renderTime[0] << std::setw(19) << renderTime[1] << std::endl;
+	}
+}
@@ -0,0 +1,107 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iostream>
+#include <random>
+
+/*!
+\brief Benchmark the slab test of a ray against all the child boxes of a node of a wide hierarchy against one box at a time.
+
+Rays start from random points around the scene, toward random directions, along the axes, or nearly along the axes
+so that some components of the direction are below the threshold of parallel slabs. Masks and depths are checked
+against Box::Intersect(const Ray&, double&, double&, double).
+\param wide the wide hierarchy
+\return false if some masks or depths differ.
+*/
+template<int W>
+bool BenchmarkSlab(const BlobTreeWide<W>& wide)
+{
+	const int count = 20000;
+	const std::vector<BlobTreeWideNode<W>>& nodes = wide.GetNodes();
+	Box box = wide.GetBox();
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Ray> rays;
+	for (int i = 0; i < count; i++)
+	{
+		Vector o = box.Center() + Vector(unit(gen) - 0.5, unit(gen) - 0.5, unit(gen) - 0.5).Scale(2.0 * box.Diagonal());
+		Vector d = Normalized(Vector(unit(gen) - 0.5, unit(gen) - 0.5, unit(gen) - 0.5));
+		int axis = i % 3;
+		if (i % 4 == 1)
+		{
+			d = Vector(0.0);
+			d[axis] = unit(gen) < 0.5 ? -1.0 : 1.0;
+		}
+		else if (i % 4 == 2)
+		{
+			d[axis] *= 1e-4;
+			d = Normalized(d);
+		}
+		rays.push_back(Ray(o, d));
+	}
+
+	std::vector<int> masks[2] = { std::vector<int>(size_t(count) * nodes.size()), std::vector<int>(size_t(count) * nodes.size()) };
+	std::vector<double> depths[2] = { std::vector<double>(size_t(count) * nodes.size() * W * 2), std::vector<double>(size_t(count) * nodes.size() * W * 2) };
+	double times[2];
+	for (int j = 0; j < 2; j++)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			for (int n = 0; n < int(nodes.size()); n++)
+			{
+				size_t index = size_t(i) * nodes.size() + n;
+				double* tmin = &depths[j][index * W * 2];
+				double* tmax = tmin + W;
+				if (j == 1)
+				{
+					masks[j][index] = BlobTreeWide<W>::RayMask(nodes[n], rays[i], tmin, tmax);
+					continue;
+				}
+				int mask = 0;
+				for (int c = 0; c < W; c++)
+				{
+					Box cb(Vector(nodes[n].a[0][c], nodes[n].a[1][c], nodes[n].a[2][c]), Vector(nodes[n].b[0][c], nodes[n].b[1][c], nodes[n].b[2][c]));
+					if (nodes[n].count[c] >= 0)
+						mask |= cb.Intersect(rays[i], tmin[c], tmax[c]) << c;
+				}
+				masks[j][index] = mask;
+			}
+		}
+		times[j] = Seconds(begin, std::chrono::steady_clock::now());
+	}
+
+	long long hits = 0;
+	long long differ = 0;
+	for (size_t index = 0; index < masks[0].size(); index++)
+	{
+		bool same = masks[0][index] == masks[1][index];
+		for (int c = 0; c < W; c++)
+		{
+			if ((masks[0][index] & (1 << c)) == 0)
+				continue;
+			hits++;
+			const double* t0 = &depths[0][index * W * 2];
+			const double* t1 = &depths[1][index * W * 2];
+			same = same && t0[c] == t1[c] && t0[W + c] == t1[W + c];
+		}
+		differ += !same;
+	}
+	long long tests = (long long)count * nodes.size();
+	std::cout << "Width " << W << ": " << tests << " node tests, " << hits << " child boxes hit" << std::endl;
+	std::cout << "  One box at a time: " << int(1000.0 * times[0]) << "ms" << std::endl;
+	std::cout << "  All children at once: " << int(1000.0 * times[1]) << "ms" << std::endl;
+	std::cout << "  Nodes that differ: " << differ << std::endl;
+	return differ == 0;
+}
+
+/*!
+\brief Benchmark the slab test on wide hierarchies of the scene of width 4 and 8.
+\return false if some masks or depths differ.
+*/
+bool BenchmarkSlab()
+{
+	bool identical = BenchmarkSlab(BlobTreeWide<4>(*tree));
+	identical = BenchmarkSlab(BlobTreeWide<8>(*tree)) && identical;
+	return identical;
+}
@@ -0,0 +1,145 @@
+#include "modes.h"
+#include "tracing.h"
+#include "evector4.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Separating axis test between a segment and a box with padded vectors, see Segment::Intersect().
+\param a, b ends of the segment
+\param ba diagonal of the box
+\param center center of the box
+*/
+inline bool Intersect(const Vector4& a, const Vector4& b, const Vector4& ba, const Vector4& center)
+{
+	Vector4 d = 0.5 * (b - a);
+	Vector4 cc = 0.5 * (a + b) - center;
+	Vector4 fd = Abs(d);
+	if (Vector4::Greater(Abs(cc), ba + fd))
+		return false;
+	Vector4 d1 = d.Rotated();
+	Vector4 d2 = d1.Rotated();
+	Vector4 cc1 = cc.Rotated();
+	Vector4 cc2 = cc1.Rotated();
+	Vector4 ba1 = ba.Rotated();
+	Vector4 ba2 = ba1.Rotated();
+	Vector4 fd1 = fd.Rotated();
+	Vector4 fd2 = fd1.Rotated();
+	return !Vector4::Greater(Abs(d1.Scale(cc2) - d2.Scale(cc1)), ba1.Scale(fd2) + ba2.Scale(fd1));
+}
+
+/*!
+\brief Benchmark the hot vector operations with padded vectors against Vector.
+
+Points, rays, segments and boxes are stored in arrays of both types. Every operation is repeated over the
+arrays, and the relative difference between the results of both types is reported, which only comes from the
+order of the operations of the dot products.
+*/
+void BenchmarkVector()
+{
+	const int count = 1 << 14;
+	const int repeat = 1000;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> unit(-1.0, 1.0);
+	std::vector<Vector> p(count), q(count), o(count), d(count);
+	for (int i = 0; i < count; i++)
+	{
+		p[i] = Vector(unit(gen), unit(gen), unit(gen));
+		q[i] = p[i] + 0.2 * Vector(unit(gen), unit(gen), unit(gen));
+		o[i] = Vector(unit(gen), unit(gen), unit(gen));
+		d[i] = Normalized(Vector(unit(gen), unit(gen), unit(gen)));
+	}
+	Vector4Array p4(count), q4(count), o4(count), d4(count);
+	Vector4fArray p4f(count);
+	for (int i = 0; i < count; i++)
+	{
+		p4[i] = Vector4(p[i]);
+		q4[i] = Vector4(q[i]);
+		o4[i] = Vector4(o[i]);
+		d4[i] = Vector4(d[i]);
+		p4f[i] = Vector4f(p[i]);
+	}
+	const Box box(Vector(-0.5), Vector(0.5));
+	const Vector4 a4(box[0]), b4(box[1]), ba4(box.Diagonal()), center4(box.Center());
+	const Vector c(0.1, 0.2, 0.3);
+	const Vector4 c4(c);
+	const Vector4f c4f(c);
+
+	std::cout << std::setw(24) << "Operation" << std::setw(12) << "Vector(ms)" << std::setw(13) << "Vector4(ms)" << std::setw(14) << "Vector4f(ms)" << std::setw(12) << "Difference" << std::endl;
+	for (int test = 0; test < 4; test++)
+	{
+		double times[3] = { 0.0, 0.0, 0.0 };
+		double results[3] = { 0.0, 0.0, 0.0 };
+		for (int j = 0; j < 3; j++)
+		{
+			if (j == 2 && test != 3)
+				continue;
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			double r = 0.0;
+			for (int k = 0; k < repeat; k++)
+			{
+				double t = 0.5 + 0.001 * k;
+				if (test == 0)
+				{
+					// Points along rays, as Ray::operator()
+					if (j == 0)
+						for (int i = 0; i < count; i++)
+							q[i] = o[i] + t * d[i];
+					else
+						for (int i = 0; i < count; i++)
+							q4[i] = o4[i] + t * d4[i];
+					r += j == 0 ? q[k][0] : q4[k][0];
+				}
+				else if (test == 1)
+				{
+					// Points inside a box, as Box::Inside()
+					int inside = 0;
+					if (j == 0)
+						for (int i = 0; i < count; i++)
+							inside += box.Inside(p[i] * t);
+					else
+						for (int i = 0; i < count; i++)
+							inside += (p4[i] * t > a4) && (p4[i] * t < b4);
+					r += inside;
+				}
+				else if (test == 2)
+				{
+					// Segments overlapping a box, as Segment::Intersect()
+					int overlap = 0;
+					if (j == 0)
+						for (int i = 0; i < count; i++)
+							overlap += Segment(p[i] * t, p[(i + k) % count]).Intersect(box);
+					else
+						for (int i = 0; i < count; i++)
+							overlap += Intersect(p4[i] * t, p4[(i + k) % count], ba4, center4);
+					r += overlap;
+				}
+				else
+				{
+					// Squared distances to the centers of primitives, as in the falloff of the field
+					double sum = 0.0;
+					if (j == 0)
+						for (int i = 0; i < count; i++)
+							sum += BlobTreeNode::CubicFalloff(SquaredNorm(p[i] - c), t);
+					else if (j == 1)
+						for (int i = 0; i < count; i++)
+							sum += BlobTreeNode::CubicFalloff(SquaredNorm(p4[i] - c4), t);
+					else
+						for (int i = 0; i < count; i++)
+							sum += BlobTreeNode::CubicFalloff(SquaredNorm(p4f[i] - c4f), t);
+					r += sum;
+				}
+			}
+			times[j] = Seconds(begin, std::chrono::steady_clock::now());
+			results[j] = r;
+		}
+		const char* names[4] = { "Ray evaluation", "Box inside", "Segment box overlap", "Falloff distances" };
+		std::cout << std::setw(24) << names[test] << std::setw(12) << int(1000.0 * times[0]) << std::setw(13) << int(1000.0 * times[1]);
+		if (test == 3)
+			std::cout << std::setw(14) << int(1000.0 * times[2]);
+		else
+			std::cout << std::setw(14) << "-";
+		std::cout << std::setw(12) << std::setprecision(3) << fabs(results[1] - results[0]) / fabs(results[0]) << std::endl;
+	}
+}
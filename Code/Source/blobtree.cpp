@@ -1,5 +1,27 @@
 #include "blobtree.h"
+#include "profiler.h"
 #include <iostream>
+#include <algorithm>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+
+/*!
+\brief Account for a leaf of the tree.
+\param depth depth of the leaf
+\param count number of primitives in the leaf
+\param bytes memory footprint of the leaf
+*/
+void BlobTreeStats::AddLeaf(int depth, int count, size_t bytes)
+{
+	nodes++;
+	leaves++;
+	primitives += count;
+	maxDepth = max(maxDepth, depth);
+	depthSum += depth;
+	memory += bytes;
+}
 
 
 /*!
@@ -12,6 +34,31 @@ BlobTreeNode::BlobTreeNode(const Box& b)
 	k = 1.0f;
 }
 
+/*!
+\brief Destructor.
+*/
+BlobTreeNode::~BlobTreeNode()
+{
+}
+
+/*!
+\brief Gather statistics on the sub-tree. Nodes are considered as leaves unless overloaded.
+\param stats returned statistics
+\param depth depth of the node
+*/
+void BlobTreeNode::Stats(BlobTreeStats& stats, int depth) const
+{
+	stats.AddLeaf(depth, 1, sizeof(*this));
+}
+
+/*!
+\brief Update the bounding box of the sub-tree after its primitives moved. Nodes are considered static unless overloaded.
+\param depth depth of the node
+*/
+void BlobTreeNode::Refit(int)
+{
+}
+
 /*
 \brief Computes the gradient of the node at a given point in space.
 \param p point
@@ -34,6 +81,16 @@ BlobTreeBlend::BlobTreeBlend(BlobTreeNode* e1, BlobTreeNode* e2) : BlobTreeNode(
 {
 	e[0] = e1;
 	e[1] = e2;
+	built = Overlap();
+}
+
+/*!
+\brief Destructor, recursively deletes the child nodes.
+*/
+BlobTreeBlend::~BlobTreeBlend()
+{
+	delete e[0];
+	delete e[1];
 }
 
 /*!
@@ -68,13 +125,85 @@ double BlobTreeBlend::K() const
 
 /*!
 \brief Computes the local lipschitz constant over a segment.
+
+The directional bound also skips the sub-trees lying behind the origin of the segment, whose primitives all contribute nothing.
 \param s segment
+\param directional if true, only bound the increase of the field along the segment, see BlobTreePoint::K(const Vector&, double, double, const Segment&, bool)
+*/
+double BlobTreeBlend::K(const Segment& s, bool directional) const
+{
+	if (!box.Intersect(s.GetBox()) || (directional && Behind(box, s)))
+		return 0.0;
+	return e[0]->K(s, directional) + e[1]->K(s, directional);
+}
+
+/*!
+\brief Computes the local lipschitz constant over a box.
+\param b box
+*/
+double BlobTreeBlend::K(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return 0.0;
+	return e[0]->K(b) + e[1]->K(b);
+}
+
+/*!
+\brief Gather statistics on the sub-tree.
+\param stats returned statistics
+\param depth depth of the node
+*/
+void BlobTreeBlend::Stats(BlobTreeStats& stats, int depth) const
+{
+	stats.nodes++;
+	stats.memory += sizeof(*this);
+	stats.overlapSum += Overlap();
+	e[0]->Stats(stats, depth + 1);
+	e[1]->Stats(stats, depth + 1);
+}
+
+/*!
+\brief Update the bounding boxes of the sub-tree bottom-up after its primitives moved.
+
+The top levels of the tree spawn one task per child, so this should be called from within a parallel region.
+\param depth depth of the node
 */
-double BlobTreeBlend::K(const Segment& s) const
+void BlobTreeBlend::Refit(int depth)
 {
-	if (!box.Intersect(s.GetBox()))
+	if (depth < 6)
+	{
+#pragma omp task
+		e[0]->Refit(depth + 1);
+		e[1]->Refit(depth + 1);
+#pragma omp taskwait
+	}
+	else
+	{
+		e[0]->Refit(depth + 1);
+		e[1]->Refit(depth + 1);
+	}
+	box = Box(e[0]->GetBox(), e[1]->GetBox());
+}
+
+/*!
+\brief Computes the overlap between the boxes of the two child nodes, as the ratio of the area of their
+intersection over the area of the box of the node. Primitives are split by their centers but their boxes
+still overlap, so this is not 0 after construction, see BuiltOverlap(). It increases as primitives move and
+the hierarchy is refitted.
+*/
+double BlobTreeBlend::Overlap() const
+{
+	Box b0 = e[0]->GetBox();
+	Box b1 = e[1]->GetBox();
+	Vector a = Vector::Max(b0[0], b1[0]);
+	Vector b = Vector::Min(b0[1], b1[1]);
+	if (!(a < b))
 		return 0.0;
-	return e[0]->K(s) + e[1]->K(s);
+	Vector d = b - a;
+	Vector n = box.Diagonal();
+	double area = d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+	double nodeArea = n[0] * n[1] + n[1] * n[2] + n[2] * n[0];
+	return nodeArea > 0.0 ? area / nodeArea : 0.0;
 }
 
 
@@ -94,6 +223,9 @@ BlobTreePoint::BlobTreePoint(const Vector& pp, double rr, double ee) : BlobTreeN
 
 /*!
 \brief Computes the intensity of the tree at a given point.
+
+This is the reference field of a point primitive, the falloff scaled by the energy, which the lipschitz
+bounds of K() assume and which PointBuffer::Intensity() reproduces.
 \param p point
 */
 double BlobTreePoint::Intensity(const Vector& p) const
@@ -101,21 +233,80 @@ double BlobTreePoint::Intensity(const Vector& p) const
 	if (!box.Inside(p))
 		return 0.0;
 	Vector delta = p - c;
-	return CubicFalloff(delta * delta, r * r);
+	return e * CubicFalloff(delta * delta, r * r);
 }
 
 /*!
 \brief Computes the local lipschitz constant over a segment.
 \param s segment
+\param directional if true, only bound the increase of the field along the segment
 */
-double BlobTreePoint::K(const Segment& s) const
+double BlobTreePoint::K(const Segment& s, bool directional) const
 {
-	Vector a = s[0];
-	Vector b = s[1];
 	if (!s.Intersect(box))
 		return 0.0f;
+	return K(c, r, e, s, directional);
+}
+
+/*!
+\brief Computes the local lipschitz constant over a box.
+\param b box
+*/
+double BlobTreePoint::K(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return 0.0;
+	return K(c, r, e, b);
+}
+
+/*!
+\brief Gather statistics on the sub-tree.
+\param stats returned statistics
+\param depth depth of the node
+*/
+void BlobTreePoint::Stats(BlobTreeStats& stats, int depth) const
+{
+	stats.AddLeaf(depth, 1, sizeof(*this));
+}
+
+/*!
+\brief Computes the local lipschitz constant of a point primitive over a segment.
+
+The segment is assumed to intersect the bounding box of the primitive.
+
+Tracers only step from samples outside the surface, so they only need to bound how fast the field increases
+along the segment. The intensity of a primitive only increases while the segment moves toward its center, so the
+directional bound is zero if the center lies behind the origin of the segment. Otherwise, with h the distance
+between the center and the line and u the distance left along the segment to the point closest to the center,
+the derivative of the falloff along the segment is 6 u (1 - (h^2 + u^2) / R^2)^2 / R^2, which increases up to
+u = sqrt((R^2 - h^2) / 5) and then decreases, so its maximum over the segment is reached at u clamped to the
+range of the segment. Unlike the sum of the absolute bounds, this neither adds up the primitives that the segment
+moves away from nor combines the largest derivative and the largest cosine found at different points.
+
+A primitive of negative energy decreases the field while the segment moves toward it and increases it while
+the segment moves away, so the directional bound does not hold and the absolute bound is returned instead.
+\param c center
+\param r radius
+\param e energy
+\param s segment
+\param directional if true, only bound the increase of the field along the segment
+*/
+double BlobTreePoint::K(const Vector& c, double r, double e, const Segment& s, bool directional)
+{
+	Vector a = s[0];
+	Vector b = s[1];
 	Vector axis = Normalized(b - a);
 	double l = (c - a) * axis;
+	if (directional && e >= 0.0)
+	{
+		double rr = r * r;
+		double hh = Math::Max(SquaredNorm(c - a) - l * l, 0.0);
+		if (l <= 0.0 || hh >= rr)
+			return 0.0;
+		double u = Math::Clamp(sqrt((rr - hh) / 5.0), Math::Max(l - Norm(b - a), 0.0), l);
+		double t = Math::Max(1.0 - (hh + u * u) / rr, 0.0);
+		return fabs(e) * 6.0 * u * t * t / rr;
+	}
 	double kk = 0.0;
 	if (l < 0.0)
 	{
@@ -128,13 +319,38 @@ double BlobTreePoint::K(const Segment& s) const
 	else
 	{
 		double dd = SquaredNorm(c - a) - (l * l);
-		Vector pc = a + axis * l;
 		kk = CubicFalloffK(dd, Math::Max(SquaredNorm(c - b), SquaredNorm(c - a)), r, e);
 	}
 	double grad = Math::Max(Math::Abs(axis * Normalized(c - a)), Math::Abs(axis * Normalized(c - b)));
 	return kk * grad;
 }
 
+/*!
+\brief Computes the local lipschitz constant of a point primitive over a box.
+
+Unlike the bound over a segment, which only holds along the direction of the segment, this bound holds
+for the norm of the gradient, as it only depends on the range of distances between the center and the box.
+\param c center
+\param r radius
+\param e energy
+\param b box
+*/
+double BlobTreePoint::K(const Vector& c, double r, double e, const Box& b)
+{
+	double dmin = 0.0;
+	double dmax = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		double u = b[0][i] - c[i];
+		double v = c[i] - b[1][i];
+		double d = Math::Max(0.0, Math::Max(u, v));
+		dmin += d * d;
+		double f = Math::Max(Math::Abs(u), Math::Abs(v));
+		dmax += f * f;
+	}
+	return CubicFalloffK(dmin, dmax, r, e);
+}
+
 /*!
 \brief Create a bounding box hierarchy.
 \param pts Set of nodes.
@@ -217,12 +433,502 @@ BlobTreeNode* BlobTreePoint::OptimizeHierarchy(const std::vector<Vector>& c, dou
 }
 
 
+/*!
+\brief Default constructor.
+*/
+PointBuffer::PointBuffer() : negative(0)
+{
+}
+
+/*!
+\brief Append a primitive to the buffer.
+\param c center
+\param rr radius
+\param ee energy
+*/
+void PointBuffer::Push(const Vector& c, double rr, double ee)
+{
+	id.push_back(Size());
+	cx.push_back(c[0]);
+	cy.push_back(c[1]);
+	cz.push_back(c[2]);
+	r.push_back(rr);
+	e.push_back(ee);
+	this->rr.push_back(rr * rr);
+	rr5.push_back((rr * rr) / 5.0);
+	kmax.push_back(BlobTreeNode::CubicFalloffK(ee, rr));
+	e6.push_back(fabs(ee) * 6.0);
+	if (ee < 0.0)
+		negative++;
+}
+
+/*!
+\brief Permute a range of primitives of the buffer.
+\param begin first primitive of the range
+\param index new order of the range, primitive begin + i is the former primitive begin + index[i].
+*/
+void PointBuffer::Reorder(int begin, const std::vector<int>& index)
+{
+	PointBuffer sorted;
+	for (int i = 0; i < int(index.size()); i++)
+	{
+		sorted.Push(Center(begin + index[i]), r[begin + index[i]], e[begin + index[i]]);
+		sorted.id[i] = id[begin + index[i]];
+	}
+	std::copy(sorted.id.begin(), sorted.id.end(), id.begin() + begin);
+	std::copy(sorted.cx.begin(), sorted.cx.end(), cx.begin() + begin);
+	std::copy(sorted.cy.begin(), sorted.cy.end(), cy.begin() + begin);
+	std::copy(sorted.cz.begin(), sorted.cz.end(), cz.begin() + begin);
+	std::copy(sorted.r.begin(), sorted.r.end(), r.begin() + begin);
+	std::copy(sorted.e.begin(), sorted.e.end(), e.begin() + begin);
+	std::copy(sorted.rr.begin(), sorted.rr.end(), rr.begin() + begin);
+	std::copy(sorted.rr5.begin(), sorted.rr5.end(), rr5.begin() + begin);
+	std::copy(sorted.kmax.begin(), sorted.kmax.end(), kmax.begin() + begin);
+	std::copy(sorted.e6.begin(), sorted.e6.end(), e6.begin() + begin);
+}
+
+/*!
+\brief Write the arrays of the buffer to a binary stream, see Read().
+\param out the stream
+\return false if the stream could not be written.
+*/
+bool PointBuffer::Write(std::ostream& out) const
+{
+	const std::vector<double>* arrays[9] = { &cx, &cy, &cz, &r, &e, &rr, &rr5, &kmax, &e6 };
+	for (const std::vector<double>* a : arrays)
+		out.write((const char*)a->data(), a->size() * sizeof(double));
+	out.write((const char*)id.data(), id.size() * sizeof(int));
+	return bool(out);
+}
+
+/*!
+\brief Read the arrays of the buffer from a binary stream written by Write(), replacing its primitives.
+\param in the stream
+\param count number of primitives
+\return false if the stream was too short.
+*/
+bool PointBuffer::Read(std::istream& in, int count)
+{
+	std::vector<double>* arrays[9] = { &cx, &cy, &cz, &r, &e, &rr, &rr5, &kmax, &e6 };
+	for (std::vector<double>* a : arrays)
+	{
+		a->resize(count);
+		in.read((char*)a->data(), count * sizeof(double));
+	}
+	id.resize(count);
+	in.read((char*)id.data(), count * sizeof(int));
+	negative = int(std::count_if(e.begin(), e.end(), [](double ee) { return ee < 0.0; }));
+	return bool(in);
+}
+
+/*!
+\brief Computes the cumulated intensity of a range of primitives at a given point.
+
+Every primitive contributes as BlobTreePoint::Intensity(), its falloff scaled by its energy.
+\param begin, end range of primitives
+\param p point
+*/
+double PointBuffer::Intensity(int begin, int end, const Vector& p) const
+{
+	double I = 0.0;
+	for (int i = begin; i < end; i++)
+	{
+		double dx = p[0] - cx[i];
+		double dy = p[1] - cy[i];
+		double dz = p[2] - cz[i];
+		double d = dx * dx + dy * dy + dz * dz;
+		I += e[i] * BlobTreeNode::CubicFalloff(d, r[i] * r[i]);
+	}
+	return I;
+}
+
+/*!
+\brief Computes the global lipschitz constant of a range of primitives.
+\param begin, end range of primitives
+*/
+double PointBuffer::K(int begin, int end) const
+{
+	double k = 0.0;
+	for (int i = begin; i < end; i++)
+		k += BlobTreeNode::CubicFalloffK(e[i], r[i]);
+	return k;
+}
+
+/*!
+\brief Computes the local lipschitz constant of a range of primitives over a segment.
+\param begin, end range of primitives
+\param s segment
+\param directional if true, only bound the increase of the field along the segment
+*/
+double PointBuffer::K(int begin, int end, const Segment& s, bool directional) const
+{
+	return K(begin, end, SegmentQuery(s), directional);
+}
+
+#ifndef __AVX__
+/*!
+\brief Separating axis test between a segment and the box of a point primitive, as in Segment::Intersect().
+\param pb primitives
+\param i primitive index
+\param q segment query
+*/
+static inline bool Overlap(const PointBuffer& pb, int i, const SegmentQuery& q)
+{
+	Box box = pb.GetBox(i);
+	Vector ba = box.Diagonal();
+	Vector cc = q.center - box.Center();
+	if (fabs(cc[0]) > ba[0] + q.extent[0] || fabs(cc[1]) > ba[1] + q.extent[1] || fabs(cc[2]) > ba[2] + q.extent[2])
+		return false;
+	if (fabs(q.half[1] * cc[2] - q.half[2] * cc[1]) > ba[1] * q.extent[2] + ba[2] * q.extent[1] ||
+		fabs(q.half[2] * cc[0] - q.half[0] * cc[2]) > ba[0] * q.extent[2] + ba[2] * q.extent[0] ||
+		fabs(q.half[0] * cc[1] - q.half[1] * cc[0]) > ba[0] * q.extent[1] + ba[1] * q.extent[0])
+		return false;
+	return true;
+}
+#endif
+
+/*!
+\brief Computes the local lipschitz constant of a point primitive over a segment from precomputed constants.
+
+Same operations in the same order as BlobTreePoint::K(const Vector&, double, double, const Segment&, bool).
+\param pb primitives
+\param i primitive index
+\param q segment query
+\param directional if true, only bound the increase of the field along the segment
+*/
+static inline double SegmentK(const PointBuffer& pb, int i, const SegmentQuery& q, bool directional)
+{
+	Vector ca = pb.Center(i) - q.a;
+	double l = ca * q.axis;
+	double la = SquaredNorm(ca);
+	if (directional)
+	{
+		double hh = Math::Max(la - l * l, 0.0);
+		if (l <= 0.0 || hh >= pb.rr[i])
+			return 0.0;
+		double u = Math::Clamp(sqrt((pb.rr[i] - hh) / 5.0), Math::Max(l - q.length, 0.0), l);
+		double t = Math::Max(1.0 - (hh + u * u) / pb.rr[i], 0.0);
+		return pb.e6[i] * u * t * t / pb.rr[i];
+	}
+	Vector cb = pb.Center(i) - q.b;
+	double lb = SquaredNorm(cb);
+
+	// Range of squared distances between the center and the segment
+	double dmin = l < 0.0 ? la : (q.length < l ? lb : la - l * l);
+	double dmax = l < 0.0 ? lb : (q.length < l ? la : Math::Max(lb, la));
+
+	// Cases of CubicFalloffK()
+	bool low = dmax < pb.rr5[i];
+	double x = low ? dmax : dmin;
+	double t = 1.0 - x / pb.rr[i];
+	double kk = (low || dmin > pb.rr5[i]) ? pb.e6[i] * (sqrt(x) / pb.rr[i]) * (t * t) : pb.kmax[i];
+	if (dmin > pb.rr[i])
+		kk = 0.0;
+
+	// Largest cosine between the axis and the directions to the ends of the segment
+	double grad = Math::Max(Math::Abs(q.axis * (ca * (1.0 / sqrt(la)))), Math::Abs(q.axis * (cb * (1.0 / sqrt(lb)))));
+	return kk * grad;
+}
+
+/*!
+\brief Computes the local lipschitz constant of a range of primitives over a segment.
+
+This is the same bound as BlobTreePoint::K(const Vector&, double, double, const Segment&, bool), with
+the same operations in the same order, but the quantities of the segment come from the query and the
+constants of the primitives are precomputed, so that only the two square roots and two divisions of the
+normalized directions to the ends of the segment and the few divisions by the squared radius remain per
+primitive. The cases of the falloff are selected without branches, and four primitives are processed at
+once when AVX is available. The bound itself is only vectorized when at least three of the four primitives
+overlap the segment, as divisions and square roots of the other lanes would be wasted.
+
+The directional bound only holds for positive energies, so the absolute bound is used for every primitive
+as soon as the buffer holds a primitive of negative energy.
+\param begin, end range of primitives
+\param q segment query
+\param directional if true, only bound the increase of the field along the segment
+*/
+double PointBuffer::K(int begin, int end, const SegmentQuery& q, bool directional) const
+{
+	directional = directional && negative == 0;
+	double k = 0.0;
+#ifdef __AVX__
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	const __m256d length = _mm256_set1_pd(q.length);
+	__m256d qa[3], qb[3], axis[3], center[3], half[3], extent[3];
+	for (int j = 0; j < 3; j++)
+	{
+		qa[j] = _mm256_set1_pd(q.a[j]);
+		qb[j] = _mm256_set1_pd(q.b[j]);
+		axis[j] = _mm256_set1_pd(q.axis[j]);
+		center[j] = _mm256_set1_pd(q.center[j]);
+		half[j] = _mm256_set1_pd(q.half[j]);
+		extent[j] = _mm256_set1_pd(q.extent[j]);
+	}
+	for (int i = begin; i < end; i += 4)
+	{
+		int n = end - i;
+		__m256i lanes = _mm256_set_epi64x(n > 3 ? -1 : 0, n > 2 ? -1 : 0, n > 1 ? -1 : 0, -1);
+		__m256d c[3] = { _mm256_maskload_pd(&cx[i], lanes), _mm256_maskload_pd(&cy[i], lanes), _mm256_maskload_pd(&cz[i], lanes) };
+		__m256d radius = _mm256_maskload_pd(&r[i], lanes);
+		__m256d RR = _mm256_maskload_pd(&rr[i], lanes);
+
+		// Separating axis test between the segment and the box of the primitive, as in Segment::Intersect()
+		__m256d ba[3], cc[3];
+		__m256d out = zero;
+		for (int j = 0; j < 3; j++)
+		{
+			__m256d lo = _mm256_sub_pd(c[j], radius);
+			__m256d hi = _mm256_add_pd(c[j], radius);
+			ba[j] = _mm256_sub_pd(hi, lo);
+			cc[j] = _mm256_sub_pd(center[j], _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_add_pd(lo, hi)));
+			out = _mm256_or_pd(out, _mm256_cmp_pd(_mm256_andnot_pd(sign, cc[j]), _mm256_add_pd(ba[j], extent[j]), _CMP_GT_OQ));
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			int u = (j + 1) % 3;
+			int v = (j + 2) % 3;
+			__m256d cross = _mm256_sub_pd(_mm256_mul_pd(half[u], cc[v]), _mm256_mul_pd(half[v], cc[u]));
+			__m256d reach = _mm256_add_pd(_mm256_mul_pd(ba[u], extent[v]), _mm256_mul_pd(ba[v], extent[u]));
+			out = _mm256_or_pd(out, _mm256_cmp_pd(_mm256_andnot_pd(sign, cross), reach, _CMP_GT_OQ));
+		}
+		__m256d overlap = _mm256_andnot_pd(out, _mm256_castsi256_pd(lanes));
+		int mask = _mm256_movemask_pd(overlap);
+		if (mask == 0)
+			continue;
+		if (_mm_popcnt_u32(mask) < 3)
+		{
+			for (int j = 0; j < 4; j++)
+				if (mask & (1 << j))
+					k += SegmentK(*this, i + j, q, directional);
+			continue;
+		}
+
+		// Distances to the ends of the segment and along its axis
+		__m256d ca[3], cb[3];
+		for (int j = 0; j < 3; j++)
+		{
+			ca[j] = _mm256_sub_pd(c[j], qa[j]);
+			cb[j] = _mm256_sub_pd(c[j], qb[j]);
+		}
+		__m256d l = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ca[0], axis[0]), _mm256_mul_pd(ca[1], axis[1])), _mm256_mul_pd(ca[2], axis[2]));
+		__m256d la = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ca[0], ca[0]), _mm256_mul_pd(ca[1], ca[1])), _mm256_mul_pd(ca[2], ca[2]));
+		__m256d E6 = _mm256_maskload_pd(&e6[i], lanes);
+		__m256d kk;
+		if (directional)
+		{
+			__m256d hh = _mm256_max_pd(_mm256_sub_pd(la, _mm256_mul_pd(l, l)), zero);
+			__m256d none = _mm256_or_pd(_mm256_cmp_pd(l, zero, _CMP_LE_OQ), _mm256_cmp_pd(hh, RR, _CMP_GE_OQ));
+			__m256d u = _mm256_sqrt_pd(_mm256_div_pd(_mm256_sub_pd(RR, hh), _mm256_set1_pd(5.0)));
+			__m256d umin = _mm256_max_pd(_mm256_sub_pd(l, length), zero);
+			u = _mm256_blendv_pd(_mm256_blendv_pd(u, l, _mm256_cmp_pd(u, l, _CMP_GT_OQ)), umin, _mm256_cmp_pd(u, umin, _CMP_LT_OQ));
+			__m256d t = _mm256_max_pd(_mm256_sub_pd(one, _mm256_div_pd(_mm256_add_pd(hh, _mm256_mul_pd(u, u)), RR)), zero);
+			kk = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(E6, u), t), t), RR);
+			kk = _mm256_blendv_pd(kk, zero, none);
+		}
+		else
+		{
+			__m256d lb = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(cb[0], cb[0]), _mm256_mul_pd(cb[1], cb[1])), _mm256_mul_pd(cb[2], cb[2]));
+			__m256d RR5 = _mm256_maskload_pd(&rr5[i], lanes);
+			__m256d before = _mm256_cmp_pd(l, zero, _CMP_LT_OQ);
+			__m256d after = _mm256_cmp_pd(length, l, _CMP_LT_OQ);
+
+			// Range of squared distances between the center and the segment
+			__m256d dmin = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_sub_pd(la, _mm256_mul_pd(l, l)), lb, after), la, before);
+			__m256d dmax = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_max_pd(lb, la), la, after), lb, before);
+
+			// Cases of CubicFalloffK()
+			__m256d low = _mm256_cmp_pd(dmax, RR5, _CMP_LT_OQ);
+			__m256d x = _mm256_blendv_pd(dmin, dmax, low);
+			__m256d t = _mm256_sub_pd(one, _mm256_div_pd(x, RR));
+			kk = _mm256_mul_pd(_mm256_mul_pd(E6, _mm256_div_pd(_mm256_sqrt_pd(x), RR)), _mm256_mul_pd(t, t));
+			kk = _mm256_blendv_pd(_mm256_maskload_pd(&kmax[i], lanes), kk, _mm256_or_pd(low, _mm256_cmp_pd(dmin, RR5, _CMP_GT_OQ)));
+			kk = _mm256_blendv_pd(kk, zero, _mm256_cmp_pd(dmin, RR, _CMP_GT_OQ));
+
+			// Largest cosine between the axis and the directions to the ends of the segment
+			__m256d ia = _mm256_div_pd(one, _mm256_sqrt_pd(la));
+			__m256d ib = _mm256_div_pd(one, _mm256_sqrt_pd(lb));
+			__m256d ga = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(axis[0], _mm256_mul_pd(ca[0], ia)), _mm256_mul_pd(axis[1], _mm256_mul_pd(ca[1], ia))), _mm256_mul_pd(axis[2], _mm256_mul_pd(ca[2], ia)));
+			__m256d gb = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(axis[0], _mm256_mul_pd(cb[0], ib)), _mm256_mul_pd(axis[1], _mm256_mul_pd(cb[1], ib))), _mm256_mul_pd(axis[2], _mm256_mul_pd(cb[2], ib)));
+			kk = _mm256_mul_pd(kk, _mm256_max_pd(_mm256_andnot_pd(sign, ga), _mm256_andnot_pd(sign, gb)));
+		}
+
+		// Accumulate the lanes in the order of the primitives, as the scalar loop does
+		double lane[4];
+		_mm256_storeu_pd(lane, _mm256_and_pd(kk, overlap));
+		for (int j = 0; j < 4 && j < n; j++)
+			k += lane[j];
+	}
+#else
+	for (int i = begin; i < end; i++)
+		if (Overlap(*this, i, q))
+			k += SegmentK(*this, i, q, directional);
+#endif
+	return k;
+}
+
+/*!
+\brief Computes the local lipschitz constant of a range of primitives over a box.
+\param begin, end range of primitives
+\param b box
+*/
+double PointBuffer::K(int begin, int end, const Box& b) const
+{
+	double k = 0.0;
+	for (int i = begin; i < end; i++)
+	{
+		if (!b.Intersect(GetBox(i)))
+			continue;
+		k += BlobTreePoint::K(Center(i), r[i], e[i], b);
+	}
+	return k;
+}
+
+
+/*!
+\brief Constructor for a leaf referencing a range of point primitives.
+\param pb primitive storage
+\param b, e range of primitives
+*/
+BlobTreePointBatch::BlobTreePointBatch(const PointBuffer* pb, int b, int e) : BlobTreeNode(pb->GetBox(b))
+{
+	buffer = pb;
+	begin = b;
+	end = e;
+	for (int i = begin + 1; i < end; i++)
+		box = Box(box, buffer->GetBox(i));
+	k = buffer->K(begin, end);
+}
+
+/*!
+\brief Computes the intensity of the leaf at a given point.
+\param p point
+*/
+double BlobTreePointBatch::Intensity(const Vector& p) const
+{
+	if (!box.Inside(p))
+		return 0.0;
+	return buffer->Intensity(begin, end, p);
+}
+
+/*!
+\brief Computes the global lipschitz constant of the leaf.
+*/
+double BlobTreePointBatch::K() const
+{
+	return k;
+}
+
+/*!
+\brief Computes the local lipschitz constant over a segment.
+\param s segment
+\param directional if true, only bound the increase of the field along the segment
+*/
+double BlobTreePointBatch::K(const Segment& s, bool directional) const
+{
+	if (!s.Intersect(box) || (directional && Behind(box, s)))
+		return 0.0;
+	return buffer->K(begin, end, s, directional);
+}
+
+/*!
+\brief Computes the local lipschitz constant over a box.
+\param b box
+*/
+double BlobTreePointBatch::K(const Box& b) const
+{
+	if (!box.Intersect(b))
+		return 0.0;
+	return buffer->K(begin, end, b);
+}
+
+/*!
+\brief Gather statistics on the sub-tree. Primitive storage is accounted for by the BlobTree.
+\param stats returned statistics
+\param depth depth of the node
+*/
+void BlobTreePointBatch::Stats(BlobTreeStats& stats, int depth) const
+{
+	stats.AddLeaf(depth, end - begin, sizeof(*this));
+}
+
+/*!
+\brief Update the bounding box of the leaf from the current position of its primitives.
+\param depth depth of the node
+*/
+void BlobTreePointBatch::Refit(int)
+{
+	box = buffer->GetBox(begin);
+	for (int i = begin + 1; i < end; i++)
+		box = Box(box, buffer->GetBox(i));
+}
+
+/*!
+\brief Create a bounding box hierarchy over a buffer of primitives.
+
+Primitives are partitioned in place, so that the primitives of every leaf end up contiguous in memory.
+\param pb primitive storage
+\param begin, end range of primitives that should be organized into the hierarchy.
+\param leafSize maximum number of primitives per leaf
+*/
+BlobTreeNode* BlobTreePointBatch::BVHRecursive(PointBuffer& pb, int begin, int end, int leafSize)
+{
+	// If leaf, returns a batch of primitives
+	int nodeCount = end - begin;
+	if (nodeCount <= leafSize)
+		return new BlobTreePointBatch(&pb, begin, end);
+
+	// Bounding box of primitive in [begin, end] range
+	Box bbox = pb.GetBox(begin);
+	for (int i = begin + 1; i < end; i++)
+		bbox = Box(bbox, pb.GetBox(i));
+
+	// Find the most stretched axis of the bounding box
+	// Cut the box in the middle of this stretched axis
+	int stretchedAxis = bbox.Diagonal().MaxIndex();
+	double axisMiddleCut = (bbox[0][stretchedAxis] + bbox[1][stretchedAxis]) / 2.0f;
+
+	// Partition our primitives in relation to the axisMiddleCut
+	std::vector<int> index(nodeCount);
+	for (int i = 0; i < nodeCount; i++)
+		index[i] = i;
+	auto pmid = std::partition(index.begin(), index.end(), [&](int i) { return pb.GetBox(begin + i).Center()[stretchedAxis] < axisMiddleCut; });
+	pb.Reorder(begin, index);
+
+	// Ensure the partition is not degenerate : all primitives on the same side
+	int midIndex = begin + int(std::distance(index.begin(), pmid));
+	if (midIndex == begin || midIndex == end)
+		midIndex = (begin + end) / 2;
+
+	// Recursive construction of sub trees
+	BlobTreeNode* left = BVHRecursive(pb, begin, midIndex, leafSize);
+	BlobTreeNode* right = BVHRecursive(pb, midIndex, end, leafSize);
+
+	// Blend of the two child nodes
+	return new BlobTreeBlend(left, right);
+}
+
+/*!
+\brief Entry point of the BVH construction over a buffer of primitives.
+\param pb primitive storage, reordered during the construction
+\param leafSize maximum number of primitives per leaf
+*/
+BlobTreeNode* BlobTreePointBatch::OptimizeHierarchy(PointBuffer& pb, int leafSize)
+{
+	if (pb.Size() == 0)
+		return nullptr;
+	ProfileScope scope("Build hierarchy");
+	return BVHRecursive(pb, 0, pb.Size(), Math::Max(leafSize, 1));
+}
+
 /*!
 \brief Default constructor.
 */
 BlobTree::BlobTree()
 {
 	root = nullptr;
+	leafSize = 1;
 }
 
 /*!
@@ -232,41 +938,79 @@ BlobTree::BlobTree()
 BlobTree::BlobTree(BlobTreeNode* rr)
 {
 	root = rr;
+	leafSize = 1;
 }
 
 /*!
 \brief Utility constructor for building the tree from a file containing sphere primitives.
 \param path file path
+\param leafSize maximum number of primitives per leaf of the hierarchy
 */
-BlobTree::BlobTree(const char* path)
+BlobTree::BlobTree(const char* path, int leafSize) : leafSize(leafSize)
 {
+	root = nullptr;
 	std::vector<Vector> centers;
+	if (!Load(path, centers))
+		return;
+	for (int i = 0; i < int(centers.size()); i++)
+		points.Push(centers[i], 2.25, 1.0);	// Hardcoded radius for the file
+	root = BlobTreePointBatch::OptimizeHierarchy(points, leafSize);
+}
+
+/*!
+\brief Constructor from a set of sphere primitives with the same radius.
+\param centers centers of the primitives
+\param radius radius of the primitives
+\param leafSize maximum number of primitives per leaf of the hierarchy
+*/
+BlobTree::BlobTree(const std::vector<Vector>& centers, double radius, int leafSize) : leafSize(leafSize)
+{
+	for (int i = 0; i < int(centers.size()); i++)
+		points.Push(centers[i], radius, 1.0);
+	root = BlobTreePointBatch::OptimizeHierarchy(points, leafSize);
+}
+
+/*!
+\brief Read the centers of sphere primitives from a file, one primitive per line.
+\param path file path
+\param centers returned centers
+\return true if the file could be read, false otherwise.
+*/
+bool BlobTree::Load(const char* path, std::vector<Vector>& centers)
+{
+	ProfileScope scope("Load scene");
 	std::ifstream inFile;
 	inFile.open(path);
 	if (!inFile)
 	{
 		std::cout << "Unable to open particle file - exiting." << std::endl;
-		root = nullptr;
-		return;
+		return false;
 	}
 	for (std::string line; std::getline(inFile, line); /* empty */)
 	{
 		std::istringstream in(line);
 		double x, y, z;
 		in >> x >> y >> z;
-		centers.push_back(Vector(x, y, z)); // Upscale all the vector field
+		centers.push_back(Vector(x, y, z));
 	}
-	root = BlobTreePoint::OptimizeHierarchy(centers, 2.25);	// Hardcoded radius for the file
-	std::cout << "Primitive count: " << centers.size() << std::endl << std::endl;
+	return true;
+}
+
+/*!
+\brief Destructor.
+*/
+BlobTree::~BlobTree()
+{
+	delete root;
 }
 
 /*!
 \brief Computes the intensity of the tree at a given point.
 \param p point
 */
-double BlobTree::Intensity(const Vector& p)
+double BlobTree::Intensity(const Vector& p) const
 {
-	return root->Intensity(p) - 0.5f;
+	return root->Intensity(p) - Threshold();
 }
 
 /*!
@@ -278,6 +1022,111 @@ Vector BlobTree::Gradient(const Vector& p) const
 	return root->Gradient(p);
 }
 
+/*!
+\brief Spread the 8 lower bits of an integer so that they occupy every third bit.
+\param x integer
+*/
+static inline unsigned int SpreadBits(unsigned int x)
+{
+	x &= 0xff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+/*!
+\brief Sort a set of points along the Morton curve of a box, so that consecutive queries visit the same nodes.
+
+Codes have 24 bits and are sorted with three passes of a radix sort on 8 bits, whose 256 buckets stay in cache.
+\param pts points
+\param box the box, points outside are clamped
+\param order returned indexes of the points, sorted
+\param sorted returned points, sorted
+*/
+static void MortonSort(const std::vector<Vector>& pts, const Box& box, std::vector<int>& order, std::vector<Vector>& sorted)
+{
+	const int n = int(pts.size());
+	const Vector a = box[0];
+	const Vector d = box.Diagonal();
+	std::vector<unsigned int> codes(n), codesTmp(n);
+	std::vector<int> orderTmp(n);
+	order.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		unsigned int c[3];
+		for (int j = 0; j < 3; j++)
+			c[j] = (unsigned int)(Math::Clamp(d[j] > 0.0 ? (pts[i][j] - a[j]) / d[j] : 0.0, 0.0, 1.0) * 255.0);
+		codes[i] = SpreadBits(c[0]) | (SpreadBits(c[1]) << 1) | (SpreadBits(c[2]) << 2);
+		order[i] = i;
+	}
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		std::vector<int> offset(257, 0);
+		for (int i = 0; i < n; i++)
+			offset[((codes[i] >> shift) & 0xff) + 1]++;
+		for (int b = 0; b < 256; b++)
+			offset[b + 1] += offset[b];
+		for (int i = 0; i < n; i++)
+		{
+			int k = offset[(codes[i] >> shift) & 0xff]++;
+			codesTmp[k] = codes[i];
+			orderTmp[k] = order[i];
+		}
+		codes.swap(codesTmp);
+		order.swap(orderTmp);
+	}
+	sorted.resize(n);
+	for (int i = 0; i < n; i++)
+		sorted[i] = pts[order[i]];
+}
+
+/*!
+\brief Computes the intensity of the tree at a set of points.
+
+Points are sorted along the Morton curve and processed in parallel by contiguous chunks, which makes
+consecutive queries of a thread traverse the same nodes. The tree is only read, so that concurrent calls are safe.
+\param pts points
+\param values returned intensities, in the order of the points
+*/
+void BlobTree::Intensity(const std::vector<Vector>& pts, std::vector<double>& values) const
+{
+	std::vector<int> order;
+	std::vector<Vector> sorted;
+	MortonSort(pts, GetBox(), order, sorted);
+	std::vector<double> results(sorted.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (int i = 0; i < int(sorted.size()); i++)
+		results[i] = Intensity(sorted[i]);
+
+	// Results are written in sorted order, and scattered afterwards
+	values.resize(pts.size());
+	for (int i = 0; i < int(sorted.size()); i++)
+		values[order[i]] = results[i];
+}
+
+/*!
+\brief Computes the gradient of the tree at a set of points, see Intensity(const std::vector<Vector>&, std::vector<double>&) const.
+\param pts points
+\param gradients returned gradients, in the order of the points
+*/
+void BlobTree::Gradient(const std::vector<Vector>& pts, std::vector<Vector>& gradients) const
+{
+	std::vector<int> order;
+	std::vector<Vector> sorted;
+	MortonSort(pts, GetBox(), order, sorted);
+	std::vector<Vector> results(sorted.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (int i = 0; i < int(sorted.size()); i++)
+		results[i] = Gradient(sorted[i]);
+
+	// Results are written in sorted order, and scattered afterwards
+	gradients.resize(pts.size());
+	for (int i = 0; i < int(sorted.size()); i++)
+		gradients[order[i]] = results[i];
+}
+
 /*!
 \brief Computes the global lipschitz constant as a recursive query.
 */
@@ -288,11 +1137,25 @@ double BlobTree::K() const
 
 /*!
 \brief Computes the local lipschitz constant over a segment.
+
+Sub-trees behind the origin of the segment are only skipped by the directional bound if all energies are positive,
+so the absolute bound is used as soon as the tree holds a primitive of negative energy. Trees built from point
+nodes rather than from the buffer are assumed to have positive energies.
 \param s segment
+\param directional if true, only bound the increase of the field along the segment, which is enough for stepping from outside the surface
 */
-double BlobTree::K(const Segment& s) const
+double BlobTree::K(const Segment& s, bool directional) const
 {
-	return root->K(s);
+	return root->K(s, directional && points.negative == 0);
+}
+
+/*!
+\brief Computes the local lipschitz constant over a box, which bounds the norm of the gradient at any point of the box.
+\param b box
+*/
+double BlobTree::K(const Box& b) const
+{
+	return root->K(b);
 }
 
 /*!
@@ -302,3 +1165,103 @@ Box BlobTree::GetBox() const
 {
 	return root->GetBox();
 }
+
+/*!
+\brief Computes statistics on the structure of the tree, including primitive storage.
+*/
+BlobTreeStats BlobTree::Stats() const
+{
+	BlobTreeStats stats;
+	if (root != nullptr)
+		root->Stats(stats, 0);
+	stats.memory += sizeof(*this) + points.Memory();
+	return stats;
+}
+
+/*!
+\brief Move the point primitives of the tree and update the hierarchy.
+
+Bounding boxes are refitted bottom-up in parallel, keeping the structure of the hierarchy. Sub-trees whose
+children overlap too much more than when they were built are then rebuilt from scratch, starting from the top
+of the tree so that a degraded root triggers a full rebuild. Comparing to the overlap at construction rather
+than to a fixed threshold keeps an update with unchanged centers from rebuilding anything. Wide hierarchies
+built from this tree should be built again after the update.
+\param centers new centers, in the order of the file the tree was built from
+\param maxGrowth ratio between the overlap of child nodes and their overlap at construction above which a sub-tree is rebuilt, see BlobTreeBlend::Overlap()
+\param minOverlap overlap at construction below which the ratio is taken against this value, so that nodes built with disjoint children do not rebuild at the slightest overlap
+\return number of rebuilt sub-trees.
+*/
+int BlobTree::Update(const std::vector<Vector>& centers, double maxGrowth, double minOverlap)
+{
+	if (root == nullptr || int(centers.size()) != points.Size())
+		return 0;
+
+#pragma omp parallel for
+	for (int i = 0; i < points.Size(); i++)
+	{
+		const Vector& c = centers[points.id[i]];
+		points.cx[i] = c[0];
+		points.cy[i] = c[1];
+		points.cz[i] = c[2];
+	}
+
+#pragma omp parallel
+#pragma omp single
+	root->Refit(0);
+
+	int rebuilt = 0;
+	root = RebuildOverlapping(root, maxGrowth, minOverlap, rebuilt);
+	return rebuilt;
+}
+
+/*!
+\brief Rebuild the topmost sub-trees whose child nodes overlap too much more than at construction.
+
+Only sub-trees whose leaves reference the primitive buffer can be rebuilt, others are left as they are.
+\param node root of the sub-tree
+\param maxGrowth ratio over the overlap at construction above which the sub-tree is rebuilt
+\param minOverlap lower bound of the overlap at construction used in the ratio
+\param rebuilt incremented for every rebuilt sub-tree
+\return the root of the sub-tree, which may be a new node.
+*/
+BlobTreeNode* BlobTree::RebuildOverlapping(BlobTreeNode* node, double maxGrowth, double minOverlap, int& rebuilt)
+{
+	BlobTreeBlend* blend = dynamic_cast<BlobTreeBlend*>(node);
+	if (blend == nullptr)
+		return node;
+
+	if (blend->Overlap() > maxGrowth * Math::Max(blend->BuiltOverlap(), minOverlap))
+	{
+		// Leaves of a sub-tree reference a contiguous range of primitives
+		const BlobTreeNode* first = blend;
+		while (dynamic_cast<const BlobTreeBlend*>(first) != nullptr)
+			first = static_cast<const BlobTreeBlend*>(first)->Child(0);
+		const BlobTreeNode* last = blend;
+		while (dynamic_cast<const BlobTreeBlend*>(last) != nullptr)
+			last = static_cast<const BlobTreeBlend*>(last)->Child(1);
+		const BlobTreePointBatch* firstBatch = dynamic_cast<const BlobTreePointBatch*>(first);
+		const BlobTreePointBatch* lastBatch = dynamic_cast<const BlobTreePointBatch*>(last);
+		if (firstBatch != nullptr && lastBatch != nullptr)
+		{
+			int begin = firstBatch->Begin();
+			int end = lastBatch->End();
+
+			delete node;
+			rebuilt++;
+			return BlobTreePointBatch::BVHRecursive(points, begin, end, leafSize);
+		}
+	}
+
+	for (int i = 0; i < 2; i++)
+		blend->SetChild(i, RebuildOverlapping(const_cast<BlobTreeNode*>(blend->Child(i)), maxGrowth, minOverlap, rebuilt));
+	return node;
+}
+
+/*!
+\brief Rebuild the whole hierarchy from the current position of the primitives.
+*/
+void BlobTree::Rebuild()
+{
+	delete root;
+	root = BlobTreePointBatch::OptimizeHierarchy(points, leafSize);
+}
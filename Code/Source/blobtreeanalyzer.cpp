@@ -0,0 +1,271 @@
+#include "blobtreeanalyzer.h"
+#include <cstdio>
+#include <iostream>
+
+/*!
+\brief Accumulate the counters of another node.
+\param a the counters
+*/
+void NodeAccess::Add(const NodeAccess& a)
+{
+	for (int q = 0; q < 2; q++)
+	{
+		reached[q] += a.reached[q];
+		culled[q] += a.culled[q];
+		useless[q] += a.useless[q];
+	}
+}
+
+/*!
+\brief Flatten a tree, whose leaves should reference ranges of its primitive storage.
+\param t the tree, which should outlive the analyzer
+*/
+BlobTreeAnalyzer::BlobTreeAnalyzer(const BlobTree& t) : tree(&t)
+{
+	if (tree->GetRoot() != nullptr)
+		Flatten(tree->GetRoot(), 0);
+	threads.resize(omp_get_max_threads(), std::vector<NodeAccess>(nodes.size()));
+}
+
+/*!
+\brief Recursively flatten a sub-tree.
+\param node root of the sub-tree
+\param depth depth of the node
+\return index of the flattened node.
+*/
+int BlobTreeAnalyzer::Flatten(const BlobTreeNode* node, int depth)
+{
+	const int i = int(nodes.size());
+	nodes.push_back(Node{ node, node->GetBox(), { -1, -1 }, depth, 0, 0, false });
+	const BlobTreeBlend* blend = dynamic_cast<const BlobTreeBlend*>(node);
+	const BlobTreePointBatch* batch = dynamic_cast<const BlobTreePointBatch*>(node);
+	if (blend != nullptr)
+	{
+		int a = Flatten(blend->Child(0), depth + 1);
+		int b = Flatten(blend->Child(1), depth + 1);
+		nodes[i].child[0] = a;
+		nodes[i].child[1] = b;
+		nodes[i].begin = min(nodes[a].begin, nodes[b].begin);
+		nodes[i].end = max(nodes[a].end, nodes[b].end);
+	}
+	else if (batch != nullptr)
+	{
+		nodes[i].leaf = true;
+		nodes[i].begin = batch->Begin();
+		nodes[i].end = batch->End();
+	}
+	return i;
+}
+
+/*!
+\brief Computes the intensity of the tree at a given point, counting the nodes reached by the query.
+\param p point
+*/
+double BlobTreeAnalyzer::Intensity(const Vector& p) const
+{
+	return Intensity(0, p, threads[omp_get_thread_num()].data()) - BlobTree::Threshold();
+}
+
+/*!
+\brief Replay BlobTreeBlend::Intensity() and BlobTreePointBatch::Intensity() on a sub-tree.
+
+Nodes that are neither blends nor leaves of primitives are evaluated as a whole, and only count as reached.
+\param i index of the node
+\param p point
+\param access counters of the calling thread
+*/
+double BlobTreeAnalyzer::Intensity(int i, const Vector& p, NodeAccess* access) const
+{
+	const Node& n = nodes[i];
+	access[i].reached[0]++;
+	if (n.child[0] < 0 && !n.leaf)
+		return n.node->Intensity(p);
+	if (!n.box.Inside(p))
+	{
+		access[i].culled[0]++;
+		return 0.0;
+	}
+	double f = n.leaf ? tree->GetPoints().Intensity(n.begin, n.end, p) : Intensity(n.child[0], p, access) + Intensity(n.child[1], p, access);
+	if (f == 0.0)
+		access[i].useless[0]++;
+	return f;
+}
+
+/*!
+\brief Computes the gradient of the tree, which is not analyzed.
+\param p point
+*/
+Vector BlobTreeAnalyzer::Gradient(const Vector& p) const
+{
+	return tree->Gradient(p);
+}
+
+/*!
+\brief Computes the global lipschitz constant of the tree.
+*/
+double BlobTreeAnalyzer::K() const
+{
+	return tree->K();
+}
+
+/*!
+\brief Computes the local lipschitz constant over a segment, counting the nodes reached by the query.
+\param s segment
+\param directional if true, only bound the increase of the field along the segment, see BlobTree::K(const Segment&, bool)
+*/
+double BlobTreeAnalyzer::K(const Segment& s, bool directional) const
+{
+	return K(0, s, directional && tree->GetPoints().negative == 0, threads[omp_get_thread_num()].data());
+}
+
+/*!
+\brief Replay BlobTreeBlend::K(const Segment&, bool) and BlobTreePointBatch::K(const Segment&, bool) on a sub-tree.
+\param i index of the node
+\param s segment
+\param directional if true, only bound the increase of the field along the segment
+\param access counters of the calling thread
+*/
+double BlobTreeAnalyzer::K(int i, const Segment& s, bool directional, NodeAccess* access) const
+{
+	const Node& n = nodes[i];
+	access[i].reached[1]++;
+	if (n.child[0] < 0 && !n.leaf)
+		return n.node->K(s, directional);
+	bool overlap = n.leaf ? s.Intersect(n.box) : n.box.Intersect(s.GetBox());
+	if (!overlap || (directional && BlobTreeNode::Behind(n.box, s)))
+	{
+		access[i].culled[1]++;
+		return 0.0;
+	}
+	double k = n.leaf ? tree->GetPoints().K(n.begin, n.end, s, directional) : K(n.child[0], s, directional, access) + K(n.child[1], s, directional, access);
+	if (k == 0.0)
+		access[i].useless[1]++;
+	return k;
+}
+
+/*!
+\brief Returns the bounding box of the tree.
+*/
+Box BlobTreeAnalyzer::GetBox() const
+{
+	return tree->GetBox();
+}
+
+/*!
+\brief Reset the counters of all the nodes.
+*/
+void BlobTreeAnalyzer::Clear()
+{
+	for (std::vector<NodeAccess>& t : threads)
+		t.assign(nodes.size(), NodeAccess());
+}
+
+/*!
+\brief Counters of every node, merged over the threads.
+*/
+std::vector<NodeAccess> BlobTreeAnalyzer::Accesses() const
+{
+	std::vector<NodeAccess> accesses(nodes.size());
+	for (const std::vector<NodeAccess>& t : threads)
+		for (int i = 0; i < int(nodes.size()); i++)
+			accesses[i].Add(t[i]);
+	return accesses;
+}
+
+/*!
+\brief Counters of the nodes of every level, the root being at level 0.
+*/
+std::vector<LevelAccess> BlobTreeAnalyzer::Levels() const
+{
+	std::vector<NodeAccess> accesses = Accesses();
+	std::vector<LevelAccess> levels;
+	for (int i = 0; i < int(nodes.size()); i++)
+	{
+		const Node& n = nodes[i];
+		if (n.depth >= int(levels.size()))
+			levels.resize(n.depth + 1);
+		LevelAccess& level = levels[n.depth];
+		level.nodes++;
+		level.Add(accesses[i]);
+		if (n.leaf)
+		{
+			level.leaves++;
+			for (int q = 0; q < 2; q++)
+				level.primitives[q] += (accesses[i].reached[q] - accesses[i].culled[q]) * (n.end - n.begin);
+		}
+	}
+	return levels;
+}
+
+/*!
+\brief Write the counters of every node to a CSV file, one node per line in depth first order.
+
+Columns are the index, depth, type and primitive count of the node, the surface area of its box,
+and the reached, culled and useless counts of Intensity and K(Segment) queries.
+\param path file path
+\return false if the file could not be written.
+*/
+bool BlobTreeAnalyzer::WriteAccesses(const char* path) const
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		std::cout << "Unable to write node accesses " << path << std::endl;
+		return false;
+	}
+	std::vector<NodeAccess> accesses = Accesses();
+	fprintf(fp, "node,depth,leaf,primitives,area,intensity_reached,intensity_culled,intensity_useless,segment_reached,segment_culled,segment_useless\n");
+	for (int i = 0; i < int(nodes.size()); i++)
+	{
+		const Node& n = nodes[i];
+		const NodeAccess& a = accesses[i];
+		Vector d = n.box.Diagonal();
+		double area = 2.0 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+		fprintf(fp, "%d,%d,%d,%d,%g,%lld,%lld,%lld,%lld,%lld,%lld\n", i, n.depth, n.leaf ? 1 : 0, n.end - n.begin, area,
+			a.reached[0], a.culled[0], a.useless[0], a.reached[1], a.culled[1], a.useless[1]);
+	}
+	return fclose(fp) == 0;
+}
+
+/*!
+\brief Draw the accesses of the nodes as an icicle plot.
+
+Every level of the tree is a band of pixels, in which a node spans the range of its primitives. The brightness of a node
+grows with the logarithm of the queries that reached it. Red is the share of the queries that found a contribution in the
+sub-tree, green the share of the useless ones and blue the share of the culled ones.
+\param query 0 for Intensity queries, 1 for K(Segment) queries
+\param width image width
+\param levelHeight height of the band of a level
+\param image returned image, row by row
+\param height returned image height
+*/
+void BlobTreeAnalyzer::Heatmap(int query, int width, int levelHeight, std::vector<Vector>& image, int& height) const
+{
+	std::vector<NodeAccess> accesses = Accesses();
+	int depth = 0;
+	long long most = 1;
+	for (int i = 0; i < int(nodes.size()); i++)
+	{
+		depth = max(depth, nodes[i].depth);
+		most = std::max(most, accesses[i].reached[query]);
+	}
+	const int count = nodes.empty() ? 1 : max(nodes[0].end - nodes[0].begin, 1);
+	height = (depth + 1) * levelHeight;
+	image.assign(size_t(width) * height, Vector(0));
+	for (int i = 0; i < int(nodes.size()); i++)
+	{
+		const Node& n = nodes[i];
+		const NodeAccess& a = accesses[i];
+		if (a.reached[query] == 0)
+			continue;
+		double heat = 255.0 * log(1.0 + double(a.reached[query])) / log(1.0 + double(most));
+		double culled = double(a.culled[query]) / double(a.reached[query]);
+		double useless = double(a.useless[query]) / double(a.reached[query]);
+		Vector color = Vector(heat * (1.0 - culled - useless), heat * useless, heat * culled);
+		int x0 = int((long long)(n.begin - nodes[0].begin) * width / count);
+		int x1 = max(int((long long)(n.end - nodes[0].begin) * width / count), x0 + 1);
+		for (int y = n.depth * levelHeight; y < (n.depth + 1) * levelHeight - 1; y++)
+			for (int x = x0; x < min(x1, width); x++)
+				image[size_t(y) * width + x] = color;
+	}
+}
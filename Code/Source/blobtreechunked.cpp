@@ -0,0 +1,375 @@
+#include "blobtreechunked.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char ChunkMagic[8] = { 'B', 'L', 'O', 'B', 'C', 'H', 'K', '1' };	//!< Signature of the scene files
+static const int64_t ChunkAlignment = 4096;										//!< Alignment of the particles of a chunk in the file
+static const int ChunkStackSize = 64;											//!< Size of the traversal stacks of the top-level tree
+
+/*!
+\brief Recursively partition particles into chunks and build the top-level tree over them.
+
+Particles are split at the median along the largest axis of their bounding box, until a range holds at most chunkSize particles.
+The offset of the chunk entries is set to the first particle of the chunk, and converted to a file offset when writing.
+\param centers particles, reordered in place
+\param begin, end range of particles
+\param radius radius of the particles
+\param chunkSize maximum number of particles per chunk
+\param nodes top-level tree
+\param chunks chunk table
+\return index of the created node.
+*/
+int BlobTreeChunked::Partition(std::vector<Vector>& centers, int begin, int end, double radius, int chunkSize, std::vector<ChunkNode>& nodes, std::vector<ChunkEntry>& chunks)
+{
+	Vector a(Math::Infinity), b(-Math::Infinity);
+	for (int i = begin; i < end; i++)
+	{
+		a = Vector::Min(a, centers[i]);
+		b = Vector::Max(b, centers[i]);
+	}
+
+	int index = int(nodes.size());
+	nodes.push_back(ChunkNode());
+	for (int j = 0; j < 3; j++)
+	{
+		nodes[index].a[j] = a[j] - radius;
+		nodes[index].b[j] = b[j] + radius;
+	}
+	nodes[index].padding = 0;
+	if (end - begin <= chunkSize)
+	{
+		ChunkEntry entry;
+		entry.offset = begin;
+		entry.count = end - begin;
+		entry.padding = 0;
+		nodes[index].k = double(end - begin) * BlobTreeNode::CubicFalloffK(1.0, radius);
+		nodes[index].child[0] = nodes[index].child[1] = -1;
+		nodes[index].chunk = int(chunks.size());
+		chunks.push_back(entry);
+		return index;
+	}
+
+	int axis = (b - a).MaxIndex();
+	int mid = (begin + end) / 2;
+	std::nth_element(centers.begin() + begin, centers.begin() + mid, centers.begin() + end, [axis](const Vector& u, const Vector& v) { return u[axis] < v[axis]; });
+	int left = Partition(centers, begin, mid, radius, chunkSize, nodes, chunks);
+	int right = Partition(centers, mid, end, radius, chunkSize, nodes, chunks);
+	nodes[index].k = nodes[left].k + nodes[right].k;
+	nodes[index].child[0] = left;
+	nodes[index].child[1] = right;
+	nodes[index].chunk = -1;
+	return index;
+}
+
+/*!
+\brief Write particles to an out-of-core scene file.
+
+The partition reorders the whole particle set in place, so converting a scene requires all its particles to fit in
+memory, three doubles each, although rendering the written file does not. No tree is built.
+\param path scene file
+\param centers particles, reordered in place into the order of the chunks
+\param radius radius of the particles
+\param chunkSize maximum number of particles per chunk
+\return false if the file could not be written.
+*/
+bool BlobTreeChunked::Write(const char* path, std::vector<Vector>& centers, double radius, int chunkSize)
+{
+	if (centers.empty())
+		return false;
+	std::vector<ChunkNode> nodes;
+	std::vector<ChunkEntry> chunks;
+	Partition(centers, 0, int(centers.size()), radius, max(chunkSize, 1), nodes, chunks);
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "Unable to write chunk file " << path << std::endl;
+		return false;
+	}
+
+	// Convert particle indexes into page aligned file offsets
+	int32_t nodeCount = int32_t(nodes.size());
+	int32_t chunkCount = int32_t(chunks.size());
+	int64_t offset = sizeof(ChunkMagic) + sizeof(double) + 2 * sizeof(int32_t) + nodeCount * sizeof(ChunkNode) + chunkCount * sizeof(ChunkEntry);
+	std::vector<int> first(chunks.size());
+	for (int i = 0; i < chunkCount; i++)
+	{
+		first[i] = int(chunks[i].offset);
+		offset = (offset + ChunkAlignment - 1) / ChunkAlignment * ChunkAlignment;
+		chunks[i].offset = offset;
+		offset += chunks[i].count * 3 * sizeof(double);
+	}
+
+	out.write(ChunkMagic, sizeof(ChunkMagic));
+	out.write((const char*)&radius, sizeof(double));
+	out.write((const char*)&nodeCount, sizeof(int32_t));
+	out.write((const char*)&chunkCount, sizeof(int32_t));
+	out.write((const char*)nodes.data(), nodeCount * sizeof(ChunkNode));
+	out.write((const char*)chunks.data(), chunkCount * sizeof(ChunkEntry));
+	std::vector<double> data;
+	for (int i = 0; i < chunkCount; i++)
+	{
+		std::vector<char> zeros(size_t(chunks[i].offset - int64_t(out.tellp())), 0);
+		out.write(zeros.data(), zeros.size());
+		data.resize(chunks[i].count * 3);
+		for (int j = 0; j < chunks[i].count; j++)
+			for (int c = 0; c < 3; c++)
+				data[3 * j + c] = centers[first[i] + j][c];
+		out.write((const char*)data.data(), data.size() * sizeof(double));
+	}
+	return bool(out);
+}
+
+/*!
+\brief Open an out-of-core scene file, only its top-level tree is loaded.
+
+The top-level tree and the chunk table are checked against the size of the file, so that a truncated or
+corrupted file is rejected here rather than when a query reaches one of its chunks. Files whose top-level tree
+is too deep for the traversal stacks of the queries are rejected as well, which median splits of the particles
+never produce.
+\param path scene file
+\param memoryCap maximum memory used by resident chunks, in bytes
+\param leafSize maximum number of primitives per leaf of the chunk trees
+*/
+BlobTreeChunked::BlobTreeChunked(const char* path, size_t memoryCap, int leafSize) : path(path), radius(0.0), leafSize(leafSize), memoryCap(memoryCap), clock(0), failed(false)
+{
+	std::ifstream file(path, std::ios::binary);
+	char magic[sizeof(ChunkMagic)];
+	int32_t nodeCount = 0, chunkCount = 0;
+	if (file)
+	{
+		file.read(magic, sizeof(magic));
+		file.read((char*)&radius, sizeof(double));
+		file.read((char*)&nodeCount, sizeof(int32_t));
+		file.read((char*)&chunkCount, sizeof(int32_t));
+	}
+	if (!file || memcmp(magic, ChunkMagic, sizeof(ChunkMagic)) != 0 || nodeCount <= 0 || chunkCount <= 0)
+	{
+		std::cout << "Unable to read chunk file " << path << std::endl;
+		return;
+	}
+	nodes.resize(nodeCount);
+	chunks.resize(chunkCount);
+	file.read((char*)nodes.data(), nodeCount * sizeof(ChunkNode));
+	file.read((char*)chunks.data(), chunkCount * sizeof(ChunkEntry));
+	const int64_t header = int64_t(file.tellg());
+	file.seekg(0, std::ios::end);
+	const int64_t size = int64_t(file.tellg());
+	bool valid = bool(file);
+
+	// Children are written after their parent, which rules out cycles in the top-level tree
+	// A traversal holds at most one node per level plus one, which must fit in the stacks of the queries
+	std::vector<int> depth(nodeCount, 0);
+	for (int i = 0; i < nodeCount && valid; i++)
+	{
+		const ChunkNode& n = nodes[i];
+		if (n.chunk >= 0)
+			valid = n.chunk < chunkCount;
+		else
+		{
+			valid = n.child[0] > i && n.child[0] < nodeCount && n.child[1] > i && n.child[1] < nodeCount && depth[i] + 2 <= ChunkStackSize;
+			for (int j = 0; j < 2 && valid; j++)
+				depth[n.child[j]] = max(depth[n.child[j]], depth[i] + 1);
+		}
+	}
+	for (int i = 0; i < chunkCount && valid; i++)
+		valid = chunks[i].count > 0 && chunks[i].offset >= header && chunks[i].offset <= size && (size - chunks[i].offset) / int64_t(3 * sizeof(double)) >= chunks[i].count;
+	if (!valid)
+	{
+		std::cout << "Unable to read chunk file " << path << ", it is truncated or corrupted" << std::endl;
+		nodes.clear();
+		return;
+	}
+	box = Box(Vector(nodes[0].a[0], nodes[0].a[1], nodes[0].a[2]), Vector(nodes[0].b[0], nodes[0].b[1], nodes[0].b[2]));
+	slots.reset(new Slot[chunkCount]);
+}
+
+/*!
+\brief Returns the tree of a chunk, loading it if needed.
+
+Resident chunks are returned without taking any lock, only refreshing their timestamp if the cache clock moved.
+\param chunk index of the chunk
+\return the tree, null if the chunk could not be read.
+*/
+std::shared_ptr<const BlobTree> BlobTreeChunked::Acquire(int chunk) const
+{
+	Slot& slot = slots[chunk];
+	std::shared_ptr<const BlobTree> tree = std::atomic_load(&slot.tree);
+	if (!tree)
+	{
+		// Threads reaching a chunk being loaded wait for it, and find it resident
+		std::lock_guard<std::mutex> loading(slot.loading);
+		tree = std::atomic_load(&slot.tree);
+		if (!tree)
+			return Load(chunk);
+	}
+	slot.hits.fetch_add(1, std::memory_order_relaxed);
+	const int64_t now = clock.load(std::memory_order_relaxed);
+	if (slot.used.load(std::memory_order_relaxed) != now)
+		slot.used.store(now, std::memory_order_relaxed);
+	return tree;
+}
+
+/*!
+\brief Read and build the tree of a chunk, then evict the least recently used chunks if needed.
+
+Should be called by the thread holding the loading lock of the chunk. The file is opened for every chunk,
+so that loads of different chunks do not share a stream.
+\param chunk index of the chunk
+\return the tree, null if the chunk could not be read.
+*/
+std::shared_ptr<const BlobTree> BlobTreeChunked::Load(int chunk) const
+{
+	Slot& slot = slots[chunk];
+	const ChunkEntry& entry = chunks[chunk];
+	std::vector<double> data(size_t(entry.count) * 3);
+	std::ifstream file(path, std::ios::binary);
+	file.seekg(entry.offset);
+	file.read((char*)data.data(), data.size() * sizeof(double));
+	if (!file)
+	{
+		if (!failed.exchange(true))
+			std::cout << "Unable to read chunk " << chunk << " of chunk file " << path << std::endl;
+		return nullptr;
+	}
+	std::vector<Vector> centers(entry.count);
+	for (int i = 0; i < entry.count; i++)
+		centers[i] = Vector(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+	std::shared_ptr<const BlobTree> tree = std::make_shared<const BlobTree>(centers, radius, leafSize);
+	const size_t footprint = tree->Stats().memory;
+	std::atomic_store(&slot.tree, tree);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	slot.footprint = footprint;
+	slot.used.store(++clock, std::memory_order_relaxed);
+	resident.push_back(chunk);
+	cacheStats.misses++;
+	cacheStats.bytesRead += data.size() * sizeof(double);
+	cacheStats.resident += footprint;
+	cacheStats.peak = std::max(cacheStats.peak, cacheStats.resident);
+
+	// Threads still using an evicted chunk keep their own reference to it
+	while (cacheStats.resident > memoryCap && resident.size() > 1)
+	{
+		int oldest = -1;
+		for (int i = 0; i < int(resident.size()); i++)
+			if (resident[i] != chunk && (oldest < 0 || slots[resident[i]].used.load(std::memory_order_relaxed) < slots[resident[oldest]].used.load(std::memory_order_relaxed)))
+				oldest = i;
+		Slot& evicted = slots[resident[oldest]];
+		std::atomic_store(&evicted.tree, std::shared_ptr<const BlobTree>());
+		cacheStats.resident -= evicted.footprint;
+		cacheStats.evictions++;
+		resident[oldest] = resident.back();
+		resident.pop_back();
+	}
+	return tree;
+}
+
+/*!
+\brief Computes the intensity of the tree at a given point.
+\param p point
+*/
+double BlobTreeChunked::Intensity(const Vector& p) const
+{
+	if (!box.Inside(p))
+		return -BlobTree::Threshold();
+	double I = 0.0;
+	int stack[ChunkStackSize];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0)
+	{
+		const ChunkNode& n = nodes[stack[--size]];
+		if (!Box(Vector(n.a[0], n.a[1], n.a[2]), Vector(n.b[0], n.b[1], n.b[2])).Inside(p))
+			continue;
+		if (n.chunk >= 0)
+		{
+			std::shared_ptr<const BlobTree> tree = Acquire(n.chunk);
+			if (tree)
+				I += tree->GetRoot()->Intensity(p);
+		}
+		else
+		{
+			stack[size++] = n.child[1];
+			stack[size++] = n.child[0];
+		}
+	}
+	return I - BlobTree::Threshold();
+}
+
+/*!
+\brief Computes the gradient of the tree at a given point.
+\param p point
+*/
+Vector BlobTreeChunked::Gradient(const Vector& p) const
+{
+	double x = Intensity(Vector(p[0] + Epsilon(), p[1], p[2])) - Intensity(Vector(p[0] - Epsilon(), p[1], p[2]));
+	double y = Intensity(Vector(p[0], p[1] + Epsilon(), p[2])) - Intensity(Vector(p[0], p[1] - Epsilon(), p[2]));
+	double z = Intensity(Vector(p[0], p[1], p[2] + Epsilon())) - Intensity(Vector(p[0], p[1], p[2] - Epsilon()));
+	return Vector(x, y, z) / (2.0f * Epsilon());
+}
+
+/*!
+\brief Returns the global lipschitz constant, stored in the top-level tree so that no chunk is loaded.
+*/
+double BlobTreeChunked::K() const
+{
+	return nodes[0].k;
+}
+
+/*!
+\brief Computes the local lipschitz constant over a segment.
+
+Only the chunks whose box overlaps the segment are loaded.
+\param s segment
+\param directional if true, only bound the increase of the field along the segment, see BlobTree::K(const Segment&, bool)
+*/
+double BlobTreeChunked::K(const Segment& s, bool directional) const
+{
+	Box sb = s.GetBox();
+	if (!box.Intersect(sb))
+		return 0.0;
+	double kk = 0.0;
+	int stack[ChunkStackSize];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0)
+	{
+		const ChunkNode& n = nodes[stack[--size]];
+		if (!Box(Vector(n.a[0], n.a[1], n.a[2]), Vector(n.b[0], n.b[1], n.b[2])).Intersect(sb))
+			continue;
+		if (n.chunk >= 0)
+		{
+			std::shared_ptr<const BlobTree> tree = Acquire(n.chunk);
+			if (tree)
+				kk += tree->K(s, directional);
+		}
+		else
+		{
+			stack[size++] = n.child[1];
+			stack[size++] = n.child[0];
+		}
+	}
+	return kk;
+}
+
+/*!
+\brief Returns the bounding box of the tree.
+*/
+Box BlobTreeChunked::GetBox() const
+{
+	return box;
+}
+
+/*!
+\brief Returns the statistics of the chunk cache.
+*/
+ChunkCacheStats BlobTreeChunked::CacheStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ChunkCacheStats stats = cacheStats;
+	for (int i = 0; i < int(chunks.size()); i++)
+		stats.hits += slots[i].hits.load(std::memory_order_relaxed);
+	return stats;
+}
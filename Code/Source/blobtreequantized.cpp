@@ -0,0 +1,249 @@
+#include "blobtreequantized.h"
+#include "profiler.h"
+#include <limits>
+
+/*!
+\brief Largest quantized coordinate.
+*/
+template<typename Q>
+static inline double QuantizedMax()
+{
+	return double(std::numeric_limits<Q>::max());
+}
+
+/*!
+\brief Compress a wide hierarchy.
+\param wide the wide hierarchy
+*/
+template<int W, typename Q>
+BlobTreeQuantized<W, Q>::BlobTreeQuantized(const BlobTreeWide<W>& wide)
+{
+	ProfileScope scope("Quantize hierarchy");
+	points = &wide.GetPoints();
+	box = wide.GetBox();
+	k = wide.K();
+	nodes.resize(wide.GetNodes().size());
+	Compress(wide, 0, box);
+}
+
+/*!
+\brief Recursively compress the nodes of a wide hierarchy.
+
+Node indexes are preserved. The frame of every node is rounded outward to single precision,
+and child boxes are rounded outward to the quantization grid, decoded coordinates being
+checked with the exact same arithmetic as the one used during traversal.
+\param wide the wide hierarchy
+\param node index of the node
+\param frame box containing all the children of the node
+*/
+template<int W, typename Q>
+void BlobTreeQuantized<W, Q>::Compress(const BlobTreeWide<W>& wide, int node, const Box& frame)
+{
+	const BlobTreeWideNode<W>& n = wide.GetNodes()[node];
+	BlobTreeQuantizedNode<W, Q>& q = nodes[node];
+	const double qmax = QuantizedMax<Q>();
+	for (int j = 0; j < 3; j++)
+	{
+		// Origin rounded down, scale rounded up so that the grid covers the frame
+		float o = float(frame[0][j]);
+		while (double(o) > frame[0][j])
+			o = nextafterf(o, -std::numeric_limits<float>::infinity());
+		float s = float(Math::Max(frame[1][j] - double(o), 1e-6) / qmax);
+		while (double(o) + qmax * double(s) < frame[1][j])
+			s = nextafterf(s, std::numeric_limits<float>::infinity());
+		q.origin[j] = o;
+		q.scale[j] = s;
+
+		for (int i = 0; i < W; i++)
+		{
+			if (n.count[i] < 0)
+			{
+				q.a[j][i] = Q(qmax);
+				q.b[j][i] = Q(0);
+				continue;
+			}
+			double qa = Math::Clamp(floor((n.a[j][i] - double(o)) / double(s)), 0.0, qmax);
+			while (qa > 0.0 && double(o) + qa * double(s) > n.a[j][i])
+				qa -= 1.0;
+			double qb = Math::Clamp(ceil((n.b[j][i] - double(o)) / double(s)), 0.0, qmax);
+			while (qb < qmax && double(o) + qb * double(s) < n.b[j][i])
+				qb += 1.0;
+			q.a[j][i] = Q(qa);
+			q.b[j][i] = Q(qb);
+		}
+	}
+	for (int i = 0; i < W; i++)
+	{
+		q.child[i] = n.child[i];
+		q.count[i] = n.count[i];
+		if (n.count[i] == 0)
+			Compress(wide, n.child[i], Box(Vector(n.a[0][i], n.a[1][i], n.a[2][i]), Vector(n.b[0][i], n.b[1][i], n.b[2][i])));
+	}
+}
+
+/*!
+\brief Decode the child boxes of a node, so that they can be tested with the SIMD routines of the uncompressed hierarchy.
+\param node the node
+\param decoded returned node, only child boxes are decoded
+*/
+template<int W, typename Q>
+void BlobTreeQuantized<W, Q>::Decode(const BlobTreeQuantizedNode<W, Q>& node, BlobTreeWideNode<W>& decoded)
+{
+	for (int j = 0; j < 3; j++)
+	{
+		const double o = double(node.origin[j]);
+		const double s = double(node.scale[j]);
+		for (int i = 0; i < W; i++)
+		{
+			decoded.a[j][i] = o + double(node.a[j][i]) * s;
+			decoded.b[j][i] = o + double(node.b[j][i]) * s;
+		}
+	}
+}
+
+/*!
+\brief Computes the intensity of the tree at a given point.
+\param p point
+*/
+template<int W, typename Q>
+double BlobTreeQuantized<W, Q>::Intensity(const Vector& p) const
+{
+	if (!box.Inside(p))
+		return -BlobTree::Threshold();
+	return Intensity(0, p) - BlobTree::Threshold();
+}
+
+/*!
+\brief Computes the intensity of a sub-tree at a given point.
+\param node index of the node
+\param p point
+*/
+template<int W, typename Q>
+double BlobTreeQuantized<W, Q>::Intensity(int node, const Vector& p) const
+{
+	const BlobTreeQuantizedNode<W, Q>& n = nodes[node];
+	BlobTreeWideNode<W> decoded;
+	Decode(n, decoded);
+	int mask = BlobTreeWide<W>::InsideMask(decoded, p);
+	double I = 0.0;
+	for (int i = 0; i < W; i++)
+	{
+		if ((mask & (1 << i)) == 0 || n.count[i] < 0)
+			continue;
+		if (n.count[i] > 0)
+			I += points->Intensity(n.child[i], n.child[i] + n.count[i], p);
+		else
+			I += Intensity(n.child[i], p);
+	}
+	return I;
+}
+
+/*!
+\brief Computes the gradient of the tree at a given point.
+\param p point
+*/
+template<int W, typename Q>
+Vector BlobTreeQuantized<W, Q>::Gradient(const Vector& p) const
+{
+	double x = Intensity(Vector(p[0] + Epsilon(), p[1], p[2])) - Intensity(Vector(p[0] - Epsilon(), p[1], p[2]));
+	double y = Intensity(Vector(p[0], p[1] + Epsilon(), p[2])) - Intensity(Vector(p[0], p[1] - Epsilon(), p[2]));
+	double z = Intensity(Vector(p[0], p[1], p[2] + Epsilon())) - Intensity(Vector(p[0], p[1], p[2] - Epsilon()));
+	return Vector(x, y, z) / (2.0f * Epsilon());
+}
+
+/*!
+\brief Returns the global lipschitz constant.
+*/
+template<int W, typename Q>
+double BlobTreeQuantized<W, Q>::K() const
+{
+	return k;
+}
+
+/*!
+\brief Computes the local lipschitz constant over a segment.
+\param s segment
+\param directional if true, only bound the increase of the field along the segment, see BlobTree::K(const Segment&, bool)
+*/
+template<int W, typename Q>
+double BlobTreeQuantized<W, Q>::K(const Segment& s, bool directional) const
+{
+	Box sb = s.GetBox();
+	if (!box.Intersect(sb))
+		return 0.0;
+	return K(0, sb, SegmentQuery(s), directional && points->negative == 0);
+}
+
+/*!
+\brief Computes the local lipschitz constant of a sub-tree over a segment.
+\param node index of the node
+\param sb bounding box of the segment
+\param q segment query
+\param directional if true, only bound the increase of the field along the segment
+*/
+template<int W, typename Q>
+double BlobTreeQuantized<W, Q>::K(int node, const Box& sb, const SegmentQuery& q, bool directional) const
+{
+	const BlobTreeQuantizedNode<W, Q>& n = nodes[node];
+	BlobTreeWideNode<W> decoded;
+	Decode(n, decoded);
+	int mask = BlobTreeWide<W>::OverlapMask(decoded, sb);
+	double kk = 0.0;
+	for (int i = 0; i < W; i++)
+	{
+		if ((mask & (1 << i)) == 0 || n.count[i] < 0)
+			continue;
+		if (n.count[i] > 0)
+			kk += points->K(n.child[i], n.child[i] + n.count[i], q, directional);
+		else
+			kk += K(n.child[i], sb, q, directional);
+	}
+	return kk;
+}
+
+/*!
+\brief Returns the bounding box of the tree.
+*/
+template<int W, typename Q>
+Box BlobTreeQuantized<W, Q>::GetBox() const
+{
+	return box;
+}
+
+/*!
+\brief Computes statistics on the structure of the tree, including primitive storage.
+*/
+template<int W, typename Q>
+BlobTreeStats BlobTreeQuantized<W, Q>::Stats() const
+{
+	BlobTreeStats stats;
+	Stats(0, stats, 0);
+	stats.memory += sizeof(*this) + points->Memory();
+	return stats;
+}
+
+/*!
+\brief Gather statistics on a sub-tree.
+\param node index of the node
+\param stats returned statistics
+\param depth depth of the node
+*/
+template<int W, typename Q>
+void BlobTreeQuantized<W, Q>::Stats(int node, BlobTreeStats& stats, int depth) const
+{
+	const BlobTreeQuantizedNode<W, Q>& n = nodes[node];
+	stats.nodes++;
+	stats.memory += sizeof(n);
+	for (int i = 0; i < W; i++)
+	{
+		if (n.count[i] > 0)
+			stats.AddLeaf(depth + 1, n.count[i], 0);
+		else if (n.count[i] == 0)
+			Stats(n.child[i], stats, depth + 1);
+	}
+}
+
+template class BlobTreeQuantized<4, uint8_t>;
+template class BlobTreeQuantized<4, uint16_t>;
+template class BlobTreeQuantized<8, uint8_t>;
+template class BlobTreeQuantized<8, uint16_t>;
@@ -0,0 +1,457 @@
+#include "blobtreewide.h"
+#include "profiler.h"
+#include <cstring>
+#include <iostream>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+static const char WideCacheMagic[8] = { 'B', 'L', 'O', 'B', 'W', 'I', 'D', '1' };	//!< Signature of the binary caches
+
+/*!
+\brief Surface area of a box, used for selecting the child nodes to collapse.
+\param box the box
+*/
+static double SurfaceArea(const Box& box)
+{
+	Vector d = box.Diagonal();
+	return 2.0 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+/*!
+\brief Build the wide hierarchy by collapsing the binary hierarchy of a tree.
+
+The tree should have been built from a file, so that its leaves reference ranges of its primitive storage.
+Other leaves, such as the BlobTreePoint of BlobTreePoint::OptimizeHierarchy(), cannot be referenced by the
+wide nodes: they are reported and left out of the hierarchy.
+\param tree the tree
+*/
+template<int W>
+BlobTreeWide<W>::BlobTreeWide(const BlobTree& tree)
+{
+	static_assert(W % 4 == 0, "Width of the hierarchy should be a multiple of 4");
+	ProfileScope scope("Collapse wide hierarchy");
+	points = &tree.GetPoints();
+	box = tree.GetBox();
+	k = tree.K();
+	int skipped = 0;
+	Collapse(tree.GetRoot(), skipped);
+	if (skipped > 0)
+		std::cout << "Unable to collapse " << skipped << " leaves which are not ranges of primitives, they are left out of the wide hierarchy" << std::endl;
+}
+
+/*!
+\brief Copy a hierarchy, referencing another copy of its primitives.
+
+The nodes are allocated by the calling thread, which is used to replicate a scene in the memory of every NUMA node.
+\param wide the hierarchy
+\param pb copy of the primitives of the hierarchy
+*/
+template<int W>
+BlobTreeWide<W>::BlobTreeWide(const BlobTreeWide& wide, const PointBuffer* pb) : nodes(wide.nodes), points(pb), box(wide.box), k(wide.k)
+{
+}
+
+/*!
+\brief Load a hierarchy and its primitives from a binary cache written by Write(), without building anything.
+
+The nodes are left empty if the cache could not be read or was written for another width.
+\param path cache file
+\param pb returned primitives, referenced by the hierarchy
+*/
+template<int W>
+BlobTreeWide<W>::BlobTreeWide(const char* path, PointBuffer* pb) : points(pb), k(0.0)
+{
+	ProfileScope scope("Load hierarchy cache");
+	std::ifstream in(path, std::ios::binary);
+	char magic[sizeof(WideCacheMagic)];
+	int32_t width = 0, nodeCount = 0, pointCount = 0;
+	double corners[6];
+	if (in)
+	{
+		in.read(magic, sizeof(magic));
+		in.read((char*)&width, sizeof(int32_t));
+		in.read((char*)&nodeCount, sizeof(int32_t));
+		in.read((char*)&pointCount, sizeof(int32_t));
+		in.read((char*)corners, sizeof(corners));
+		in.read((char*)&k, sizeof(double));
+	}
+	if (!in || memcmp(magic, WideCacheMagic, sizeof(WideCacheMagic)) != 0 || width != W || nodeCount <= 0)
+	{
+		std::cout << "Unable to read hierarchy cache " << path << std::endl;
+		return;
+	}
+	box = Box(Vector(corners[0], corners[1], corners[2]), Vector(corners[3], corners[4], corners[5]));
+	nodes.resize(nodeCount);
+	in.read((char*)nodes.data(), nodeCount * sizeof(BlobTreeWideNode<W>));
+	if (!in || !pb->Read(in, pointCount))
+	{
+		std::cout << "Unable to read hierarchy cache " << path << std::endl;
+		nodes.clear();
+	}
+}
+
+/*!
+\brief Write the nodes and the primitives of the hierarchy to a binary cache.
+
+The cache holds an 8 byte signature, the width, node and primitive counts as 32 bit integers, the bounding box
+and the global lipschitz constant, the raw nodes and the arrays of the primitive storage. It is meant to be read
+by the same executable on the same machine, and is not portable across architectures.
+\param path cache file
+\return false if the file could not be written.
+*/
+template<int W>
+bool BlobTreeWide<W>::Write(const char* path) const
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "Unable to write hierarchy cache " << path << std::endl;
+		return false;
+	}
+	int32_t counts[3] = { W, int32_t(nodes.size()), int32_t(points->Size()) };
+	double corners[6] = { box[0][0], box[0][1], box[0][2], box[1][0], box[1][1], box[1][2] };
+	out.write(WideCacheMagic, sizeof(WideCacheMagic));
+	out.write((const char*)counts, sizeof(counts));
+	out.write((const char*)corners, sizeof(corners));
+	out.write((const char*)&k, sizeof(double));
+	out.write((const char*)nodes.data(), nodes.size() * sizeof(BlobTreeWideNode<W>));
+	return points->Write(out);
+}
+
+/*!
+\brief Recursively collapse a binary sub-tree into wide nodes.
+
+The child with the largest surface area is opened until the W slots of the node are used. Leaves other than
+BlobTreePointBatch are left as empty slots, and a null sub-tree gives a node whose slots are all empty.
+\param node root of the binary sub-tree
+\param skipped returned number of leaves left out
+\return index of the created wide node.
+*/
+template<int W>
+int BlobTreeWide<W>::Collapse(const BlobTreeNode* node, int& skipped)
+{
+	std::vector<const BlobTreeNode*> slots;
+	const BlobTreeBlend* blend = dynamic_cast<const BlobTreeBlend*>(node);
+	if (blend != nullptr)
+	{
+		slots.push_back(blend->Child(0));
+		slots.push_back(blend->Child(1));
+	}
+	else if (node != nullptr)
+		slots.push_back(node);
+
+	while (int(slots.size()) < W)
+	{
+		int largest = -1;
+		double area = -1.0;
+		for (int i = 0; i < int(slots.size()); i++)
+		{
+			if (dynamic_cast<const BlobTreeBlend*>(slots[i]) == nullptr)
+				continue;
+			double a = SurfaceArea(slots[i]->GetBox());
+			if (a > area)
+			{
+				area = a;
+				largest = i;
+			}
+		}
+		if (largest == -1)
+			break;
+		const BlobTreeBlend* opened = static_cast<const BlobTreeBlend*>(slots[largest]);
+		slots[largest] = opened->Child(0);
+		slots.insert(slots.begin() + largest + 1, opened->Child(1));
+	}
+
+	// Children are created recursively, so nodes should be accessed by index
+	int index = int(nodes.size());
+	nodes.push_back(BlobTreeWideNode<W>());
+	for (int i = 0; i < W; i++)
+	{
+		Box cb = Box(Vector(Math::Infinity), Vector(-Math::Infinity));
+		int child = 0;
+		int count = -1;
+		if (i < int(slots.size()))
+		{
+			const BlobTreePointBatch* leaf = dynamic_cast<const BlobTreePointBatch*>(slots[i]);
+			if (leaf != nullptr)
+			{
+				cb = leaf->GetBox();
+				child = leaf->Begin();
+				count = leaf->End() - leaf->Begin();
+			}
+			else if (dynamic_cast<const BlobTreeBlend*>(slots[i]) != nullptr)
+			{
+				cb = slots[i]->GetBox();
+				child = Collapse(slots[i], skipped);
+				count = 0;
+			}
+			else
+				skipped++;
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			nodes[index].a[j][i] = cb[0][j];
+			nodes[index].b[j][i] = cb[1][j];
+		}
+		nodes[index].child[i] = child;
+		nodes[index].count[i] = count;
+	}
+	return index;
+}
+
+/*!
+\brief Computes the mask of the child boxes containing a point.
+\param node the node
+\param p point
+*/
+template<int W>
+int BlobTreeWide<W>::InsideMask(const BlobTreeWideNode<W>& node, const Vector& p)
+{
+	int mask = 0;
+#ifdef __AVX__
+	const __m256d px = _mm256_set1_pd(p[0]);
+	const __m256d py = _mm256_set1_pd(p[1]);
+	const __m256d pz = _mm256_set1_pd(p[2]);
+	for (int i = 0; i < W; i += 4)
+	{
+		__m256d x = _mm256_and_pd(_mm256_cmp_pd(px, _mm256_loadu_pd(node.a[0] + i), _CMP_GT_OQ), _mm256_cmp_pd(px, _mm256_loadu_pd(node.b[0] + i), _CMP_LT_OQ));
+		__m256d y = _mm256_and_pd(_mm256_cmp_pd(py, _mm256_loadu_pd(node.a[1] + i), _CMP_GT_OQ), _mm256_cmp_pd(py, _mm256_loadu_pd(node.b[1] + i), _CMP_LT_OQ));
+		__m256d z = _mm256_and_pd(_mm256_cmp_pd(pz, _mm256_loadu_pd(node.a[2] + i), _CMP_GT_OQ), _mm256_cmp_pd(pz, _mm256_loadu_pd(node.b[2] + i), _CMP_LT_OQ));
+		mask |= _mm256_movemask_pd(_mm256_and_pd(x, _mm256_and_pd(y, z))) << i;
+	}
+#else
+	for (int i = 0; i < W; i++)
+	{
+		bool inside = (p[0] > node.a[0][i]) & (p[0] < node.b[0][i]) & (p[1] > node.a[1][i]) & (p[1] < node.b[1][i]) & (p[2] > node.a[2][i]) & (p[2] < node.b[2][i]);
+		mask |= int(inside) << i;
+	}
+#endif
+	return mask;
+}
+
+/*!
+\brief Computes the mask of the child boxes overlapping a box, with the same convention as Box::Intersect(const Box&).
+\param node the node
+\param box the box
+*/
+template<int W>
+int BlobTreeWide<W>::OverlapMask(const BlobTreeWideNode<W>& node, const Box& box)
+{
+	int mask = 0;
+	const Vector sa = box[0];
+	const Vector sb = box[1];
+#ifdef __AVX__
+	for (int i = 0; i < W; i += 4)
+	{
+		__m256d m = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		for (int j = 0; j < 3; j++)
+		{
+			__m256d lo = _mm256_cmp_pd(_mm256_loadu_pd(node.a[j] + i), _mm256_set1_pd(sb[j]), _CMP_LT_OQ);
+			__m256d hi = _mm256_cmp_pd(_mm256_loadu_pd(node.b[j] + i), _mm256_set1_pd(sa[j]), _CMP_GT_OQ);
+			m = _mm256_and_pd(m, _mm256_and_pd(lo, hi));
+		}
+		mask |= _mm256_movemask_pd(m) << i;
+	}
+#else
+	for (int i = 0; i < W; i++)
+	{
+		bool overlap = (node.a[0][i] < sb[0]) & (node.b[0][i] > sa[0]) & (node.a[1][i] < sb[1]) & (node.b[1][i] > sa[1]) & (node.a[2][i] < sb[2]) & (node.b[2][i] > sa[2]);
+		mask |= int(overlap) << i;
+	}
+#endif
+	return mask;
+}
+
+/*!
+\brief Computes the mask of the child boxes intersected by a ray, with the same convention and the same depths as Box::Intersect(const Ray&, double&, double&, double).
+
+Whether an axis is parallel to the ray only depends on the ray, so that every lane follows the same path. Empty slots are never intersected.
+\param node the node
+\param ray the ray
+\param tmin, tmax returned entry and exit depths of every child box, W values each
+\param epsilon threshold on the components of the direction below which the ray is parallel to the slab
+*/
+template<int W>
+int BlobTreeWide<W>::RayMask(const BlobTreeWideNode<W>& node, const Ray& ray, double* tmin, double* tmax, double epsilon)
+{
+	int mask = 0;
+#ifdef __AVX__
+	for (int i = 0; i < W; i += 4)
+	{
+		__m256d t0 = _mm256_set1_pd(-1e16);
+		__m256d t1 = _mm256_set1_pd(1e16);
+		__m256d outside = _mm256_setzero_pd();
+		for (int j = 0; j < 3; j++)
+		{
+			__m256d a = _mm256_loadu_pd(node.a[j] + i);
+			__m256d b = _mm256_loadu_pd(node.b[j] + i);
+			__m256d o = _mm256_set1_pd(ray.o[j]);
+			if (fabs(ray.d[j]) <= epsilon)
+			{
+				outside = _mm256_or_pd(outside, _mm256_or_pd(_mm256_cmp_pd(o, a, _CMP_LT_OQ), _mm256_cmp_pd(o, b, _CMP_GT_OQ)));
+				continue;
+			}
+			__m256d inv = _mm256_set1_pd(ray.inv[j]);
+			__m256d ta = _mm256_mul_pd(_mm256_sub_pd(a, o), inv);
+			__m256d tb = _mm256_mul_pd(_mm256_sub_pd(b, o), inv);
+			t0 = _mm256_max_pd(t0, _mm256_min_pd(ta, tb));
+			t1 = _mm256_min_pd(t1, _mm256_max_pd(ta, tb));
+		}
+		_mm256_storeu_pd(tmin + i, t0);
+		_mm256_storeu_pd(tmax + i, t1);
+		mask |= _mm256_movemask_pd(_mm256_andnot_pd(outside, _mm256_cmp_pd(t0, t1, _CMP_LE_OQ))) << i;
+	}
+#else
+	for (int i = 0; i < W; i++)
+	{
+		Box box(Vector(node.a[0][i], node.a[1][i], node.a[2][i]), Vector(node.b[0][i], node.b[1][i], node.b[2][i]));
+		mask |= box.Intersect(ray, tmin[i], tmax[i], epsilon) << i;
+	}
+#endif
+	for (int i = 0; i < W; i++)
+		if (node.count[i] < 0)
+			mask &= ~(1 << i);
+	return mask;
+}
+
+/*!
+\brief Computes the intensity of the tree at a given point.
+\param p point
+*/
+template<int W>
+double BlobTreeWide<W>::Intensity(const Vector& p) const
+{
+	if (!box.Inside(p))
+		return -BlobTree::Threshold();
+	return Intensity(0, p) - BlobTree::Threshold();
+}
+
+/*!
+\brief Computes the intensity of a sub-tree at a given point.
+\param node index of the node
+\param p point
+*/
+template<int W>
+double BlobTreeWide<W>::Intensity(int node, const Vector& p) const
+{
+	const BlobTreeWideNode<W>& n = nodes[node];
+	int mask = InsideMask(n, p);
+	double I = 0.0;
+	for (int i = 0; i < W; i++)
+	{
+		if ((mask & (1 << i)) == 0)
+			continue;
+		if (n.count[i] > 0)
+			I += points->Intensity(n.child[i], n.child[i] + n.count[i], p);
+		else
+			I += Intensity(n.child[i], p);
+	}
+	return I;
+}
+
+/*!
+\brief Computes the gradient of the tree at a given point.
+\param p point
+*/
+template<int W>
+Vector BlobTreeWide<W>::Gradient(const Vector& p) const
+{
+	double x = Intensity(Vector(p[0] + Epsilon(), p[1], p[2])) - Intensity(Vector(p[0] - Epsilon(), p[1], p[2]));
+	double y = Intensity(Vector(p[0], p[1] + Epsilon(), p[2])) - Intensity(Vector(p[0], p[1] - Epsilon(), p[2]));
+	double z = Intensity(Vector(p[0], p[1], p[2] + Epsilon())) - Intensity(Vector(p[0], p[1], p[2] - Epsilon()));
+	return Vector(x, y, z) / (2.0f * Epsilon());
+}
+
+/*!
+\brief Returns the global lipschitz constant.
+*/
+template<int W>
+double BlobTreeWide<W>::K() const
+{
+	return k;
+}
+
+/*!
+\brief Computes the local lipschitz constant over a segment.
+\param s segment
+\param directional if true, only bound the increase of the field along the segment, see BlobTree::K(const Segment&, bool)
+*/
+template<int W>
+double BlobTreeWide<W>::K(const Segment& s, bool directional) const
+{
+	Box sb = s.GetBox();
+	if (!box.Intersect(sb))
+		return 0.0;
+	return K(0, sb, SegmentQuery(s), directional && points->negative == 0);
+}
+
+/*!
+\brief Computes the local lipschitz constant of a sub-tree over a segment.
+\param node index of the node
+\param sb bounding box of the segment
+\param q segment query
+\param directional if true, only bound the increase of the field along the segment
+*/
+template<int W>
+double BlobTreeWide<W>::K(int node, const Box& sb, const SegmentQuery& q, bool directional) const
+{
+	const BlobTreeWideNode<W>& n = nodes[node];
+	int mask = OverlapMask(n, sb);
+	double kk = 0.0;
+	for (int i = 0; i < W; i++)
+	{
+		if ((mask & (1 << i)) == 0)
+			continue;
+		if (n.count[i] > 0)
+			kk += points->K(n.child[i], n.child[i] + n.count[i], q, directional);
+		else
+			kk += K(n.child[i], sb, q, directional);
+	}
+	return kk;
+}
+
+/*!
+\brief Returns the bounding box of the tree.
+*/
+template<int W>
+Box BlobTreeWide<W>::GetBox() const
+{
+	return box;
+}
+
+/*!
+\brief Computes statistics on the structure of the tree, including primitive storage.
+*/
+template<int W>
+BlobTreeStats BlobTreeWide<W>::Stats() const
+{
+	BlobTreeStats stats;
+	Stats(0, stats, 0);
+	stats.memory += sizeof(*this) + points->Memory();
+	return stats;
+}
+
+/*!
+\brief Gather statistics on a sub-tree.
+\param node index of the node
+\param stats returned statistics
+\param depth depth of the node
+*/
+template<int W>
+void BlobTreeWide<W>::Stats(int node, BlobTreeStats& stats, int depth) const
+{
+	const BlobTreeWideNode<W>& n = nodes[node];
+	stats.nodes++;
+	stats.memory += sizeof(n);
+	for (int i = 0; i < W; i++)
+	{
+		if (n.count[i] > 0)
+			stats.AddLeaf(depth + 1, n.count[i], 0);
+		else if (n.count[i] == 0)
+			Stats(n.child[i], stats, depth + 1);
+	}
+}
+
+template class BlobTreeWide<4>;
+template class BlobTreeWide<8>;
@@ -1,4 +1,5 @@
 #include "fundamentals.h"
+#include <cmath>
 
 /*!
 \brief
@@ -7,6 +8,7 @@ Ray::Ray(const Vector& pp, const Vector& dd)
 {
 	o = pp;
 	d = dd;
+	inv = dd.Inverse();
 }
 
 /*!
@@ -53,120 +55,31 @@ bool Box::Inside(const Vector& p) const
 }
 
 /*!
-\brief
+\brief Intersect a ray with the box, using the slab test.
+
+The entry and exit depths of the slabs of every axis are computed with the inverse direction of the ray, and combined
+with minimums and maximums rather than branches. Axes along which the direction is smaller than epsilon are considered
+parallel to the ray: their slab does not constrain the depths, but the origin of the ray should lie inside it.
+\param ray the ray
+\param tmin, tmax returned entry and exit depths
+\param epsilon threshold on the components of the direction below which the ray is parallel to the slab
+\return 1 if the ray intersects the box, 0 otherwise.
 */
 int Box::Intersect(const Ray& ray, double& tmin, double& tmax, double epsilon) const
 {
 	tmin = -1e16;
 	tmax = 1e16;
-
-	Vector p = ray.o;
-	Vector d = ray.d;
-
-	double t;
-	// Ox
-	if (d[0] < -epsilon)
-	{
-		t = (a[0] - p[0]) / d[0];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (b[0] - p[0]) / d[0];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
-	}
-	else if (d[0] > epsilon)
-	{
-		t = (b[0] - p[0]) / d[0];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (a[0] - p[0]) / d[0];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
-	}
-	else if (p[0]<a[0] || p[0]>b[0])
-		return 0;
-
-	// Oy
-	if (d[1] < -epsilon)
-	{
-		t = (a[1] - p[1]) / d[1];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (b[1] - p[1]) / d[1];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
-	}
-	else if (d[1] > epsilon)
-	{
-		t = (b[1] - p[1]) / d[1];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (a[1] - p[1]) / d[1];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
-	}
-	else if (p[1]<a[1] || p[1]>b[1])
-		return 0;
-
-	// Oz
-	if (d[2] < -epsilon)
-	{
-		t = (a[2] - p[2]) / d[2];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (b[2] - p[2]) / d[2];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
-	}
-	else if (d[2] > epsilon)
+	bool outside = false;
+	for (int i = 0; i < 3; i++)
 	{
-		t = (b[2] - p[2]) / d[2];
-		if (t < tmin)
-			return 0;
-		if (t <= tmax)
-			tmax = t;
-		t = (a[2] - p[2]) / d[2];
-		if (t >= tmin)
-		{
-			if (t > tmax)
-				return 0;
-			tmin = t;
-		}
+		double ta = (a[i] - ray.o[i]) * ray.inv[i];
+		double tb = (b[i] - ray.o[i]) * ray.inv[i];
+		bool parallel = fabs(ray.d[i]) <= epsilon;
+		tmin = parallel ? tmin : Math::Max(tmin, Math::Min(ta, tb));
+		tmax = parallel ? tmax : Math::Min(tmax, Math::Max(ta, tb));
+		outside |= parallel & ((ray.o[i] < a[i]) | (ray.o[i] > b[i]));
 	}
-	else if (p[2]<a[2] || p[2]>b[2])
-		return 0;
-
-	return 1;
+	return int(!outside & (tmin <= tmax));
 }
 
 /*!
@@ -278,3 +191,48 @@ Box Segment::GetBox() const
 {
 	return Box(Vector::Min(a, b), Vector::Max(a, b));
 }
+
+/*!
+\brief Check that a camera at a given position has a well defined basis.
+
+The camera looks at the origin with the z axis up, so a position at the origin or on the z axis leaves the
+view direction or the horizontal axis undefined, and every ray would be NaN.
+\param eye camera position
+*/
+bool Camera::Valid(const Vector& eye)
+{
+	return std::isfinite(eye[0]) && std::isfinite(eye[1]) && std::isfinite(eye[2]) && eye[0] * eye[0] + eye[1] * eye[1] > 0.0;
+}
+
+/*!
+\brief Create a camera looking at the origin.
+\param e camera position
+\param w, h image resolution
+*/
+Camera::Camera(const Vector& e, int w, int h) : eye(e), width(w), height(h), columns(w), rows(h)
+{
+	// Camera parameters
+	const double cah = 1.995;
+	const double fl = 35.0;
+
+	// Basis
+	view = Normalized(-eye);
+	Vector horizontal = Normalized(view / Vector(0, 0, 1.0f));
+	Vector vertical = Normalized(horizontal / view);
+
+	// Field of view
+	double avh = 2.0 * atan(cah * 25.4 * 0.5 / fl);
+	double avv = 2.0 * atan(tan(avh / 2.0) * double(height) / double(width));
+	double vLength = tan(avv / 2.0f);
+	double hLength = vLength * (double(width) / double(height));
+	vertical *= vLength;
+	horizontal *= hLength;
+
+	// Pixel coordinates scaled so that half the view port width and height becomes 1.0
+	for (int i = 0; i < width; i++)
+		columns[i] = horizontal * ((i - width / 2.0) / (width / 2.0));
+	for (int j = 0; j < height; j++)
+		rows[j] = vertical * ((height / 2.0 - j) / (height / 2.0));
+	dx = horizontal / (width / 2.0);
+	dy = -vertical / (height / 2.0);
+}
@@ -0,0 +1,243 @@
+#include "localsocket.h"
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+#ifdef __linux__
+extern char** environ;	//!< Environment of the process, inherited by the launched processes
+#endif
+
+/*!
+\brief Create a socket listening for connections on a path, replacing any file at that path.
+\param path path of the socket, shorter than 100 characters
+\param backlog number of pending connections
+\return the socket, -1 if it could not be created.
+*/
+int LocalSocket::Listen(const char* path, int backlog)
+{
+#ifndef _WIN32
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path);
+	unlink(path);
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return -1;
+	if (bind(s, (const sockaddr*)&address, sizeof(address)) != 0 || listen(s, backlog) != 0)
+	{
+		close(s);
+		std::cout << "Unable to listen on socket " << path << std::endl;
+		return -1;
+	}
+	return s;
+#else
+	std::cout << "Local sockets are not supported on this system" << std::endl;
+	return -1;
+#endif
+}
+
+/*!
+\brief Wait for a connection on a listening socket.
+\param listener the listening socket
+\param timeout maximum waiting time in milliseconds, negative to wait forever
+\return the connected socket, -1 if no connection came in time.
+*/
+int LocalSocket::Accept(int listener, int timeout)
+{
+#ifndef _WIN32
+	if (Wait(std::vector<int>(1, listener), timeout) != 0)
+		return -1;
+	return accept(listener, nullptr, nullptr);
+#else
+	return -1;
+#endif
+}
+
+/*!
+\brief Connect to a listening socket.
+\param path path of the socket
+\return the connected socket, -1 if the connection failed.
+*/
+int LocalSocket::Connect(const char* path)
+{
+#ifndef _WIN32
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path);
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return -1;
+	if (connect(s, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(s);
+		std::cout << "Unable to connect to socket " << path << std::endl;
+		return -1;
+	}
+	return s;
+#else
+	return -1;
+#endif
+}
+
+/*!
+\brief Close a socket, ignoring invalid sockets.
+\param socket the socket
+*/
+void LocalSocket::Close(int socket)
+{
+#ifndef _WIN32
+	if (socket >= 0)
+		close(socket);
+#endif
+}
+
+/*!
+\brief Send a message.
+\param socket connected socket
+\param data, size the message
+\return false if the connection was closed.
+*/
+bool LocalSocket::Send(int socket, const void* data, size_t size)
+{
+#ifndef _WIN32
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = send(socket, p, size, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= size_t(n);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*!
+\brief Receive a message of a known size.
+\param socket connected socket
+\param data, size returned message
+\return false if the connection was closed before the whole message was received.
+*/
+bool LocalSocket::Receive(int socket, void* data, size_t size)
+{
+#ifndef _WIN32
+	char* p = static_cast<char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = recv(socket, p, size, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= size_t(n);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*!
+\brief Wait until one of the sockets has data to read, or was closed by its peer.
+\param sockets the sockets, invalid ones are ignored
+\param timeout maximum waiting time in milliseconds, negative to wait forever
+\return index of the first ready socket, -1 on timeout.
+*/
+int LocalSocket::Wait(const std::vector<int>& sockets, int timeout)
+{
+#ifndef _WIN32
+	std::vector<pollfd> fds(sockets.size());
+	for (int i = 0; i < int(sockets.size()); i++)
+		fds[i] = pollfd{ sockets[i], POLLIN, 0 };
+	if (poll(fds.data(), fds.size(), timeout) <= 0)
+		return -1;
+	for (int i = 0; i < int(fds.size()); i++)
+		if (fds[i].revents != 0)
+			return i;
+#endif
+	return -1;
+}
+
+/*!
+\brief Launch the running executable with other arguments.
+
+The child runs /proc/self/exe, so that the coordinator and its workers always share the same binary,
+with OMP_NUM_THREADS set to the number of threads given to the process.
+\param args arguments, the first one being the name of the program
+\param threads number of threads of the process
+\return the process identifier, -1 if the process could not be launched.
+*/
+int LocalProcess::Spawn(const std::vector<std::string>& args, int threads)
+{
+#ifdef __linux__
+	std::vector<char*> argv;
+	for (const std::string& a : args)
+		argv.push_back(const_cast<char*>(a.c_str()));
+	argv.push_back(nullptr);
+
+	// Environment of the child, built before forking since only async-signal-safe calls are allowed in the child
+	std::string count = "OMP_NUM_THREADS=" + std::to_string(threads);
+	std::vector<char*> envp;
+	for (char** e = environ; *e != nullptr; e++)
+		if (strncmp(*e, "OMP_NUM_THREADS=", 16) != 0)
+			envp.push_back(*e);
+	envp.push_back(const_cast<char*>(count.c_str()));
+	envp.push_back(nullptr);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execve("/proc/self/exe", argv.data(), envp.data());
+		_exit(127);
+	}
+	return pid < 0 ? -1 : int(pid);
+#else
+	std::cout << "Launching processes is not supported on this system" << std::endl;
+	return -1;
+#endif
+}
+
+/*!
+\brief Wait for the end of a process.
+\param process process identifier, ignored if negative
+\return false if the process failed.
+*/
+bool LocalProcess::Join(int process)
+{
+#ifdef __linux__
+	if (process < 0)
+		return false;
+	int status = 0;
+	if (waitpid(pid_t(process), &status, 0) < 0)
+		return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+	return false;
+#endif
+}
+
+/*!
+\brief Identifier of the running process, used to name the files shared with the launched processes.
+*/
+int LocalProcess::Id()
+{
+#ifndef _WIN32
+	return int(getpid());
+#else
+	return _getpid();
+#endif
+}
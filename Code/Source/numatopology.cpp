@@ -0,0 +1,130 @@
+#include "numatopology.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/*!
+\brief Parse a list of processors or nodes such as 0-3,8-11.
+\param list the list
+*/
+static std::vector<int> ParseCpuList(const std::string& list)
+{
+	std::vector<int> cpus;
+	std::istringstream ranges(list);
+	for (std::string range; std::getline(ranges, range, ','); /* empty */)
+	{
+		int first = 0;
+		int last = 0;
+		char dash = 0;
+		std::istringstream in(range);
+		if (!(in >> first))
+			continue;
+		if (!(in >> dash >> last))
+			last = first;
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+/*!
+\brief Detect the nodes of the machine.
+*/
+NumaTopology::NumaTopology()
+{
+#ifdef __linux__
+	std::ifstream online("/sys/devices/system/node/online");
+	std::string nodes;
+	std::getline(online, nodes);
+	for (int node : ParseCpuList(nodes))
+	{
+		std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		std::string list;
+		std::getline(in, list);
+		std::vector<int> c = ParseCpuList(list);
+		if (!c.empty())
+		{
+			ids.push_back(node);
+			cpus.push_back(c);
+		}
+	}
+#endif
+	if (cpus.empty())
+	{
+		ids.push_back(0);
+		cpus.push_back(std::vector<int>());
+		for (int cpu = 0; cpu < int(std::max(std::thread::hardware_concurrency(), 1u)); cpu++)
+			cpus[0].push_back(cpu);
+	}
+}
+
+/*!
+\brief Pin the calling thread on a processor.
+\param cpu the processor
+\return false if the thread could not be pinned.
+*/
+bool NumaTopology::Pin(int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+/*!
+\brief Node holding the page of an address, which should have been touched.
+\param address the address
+\return the node, -1 if it could not be queried.
+*/
+int NumaTopology::NodeOf(const void* address)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+	const unsigned long MPOL_F_NODE = 1;
+	const unsigned long MPOL_F_ADDR = 2;
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+		return -1;
+	return node;
+#else
+	return -1;
+#endif
+}
+
+/*!
+\brief Count the pages of a block of memory on a node and on the other nodes.
+\param data the block
+\param size size of the block in bytes
+\param id identifier of the expected node, see Id()
+\param placement returned counts, accumulated with those of previous blocks
+*/
+void NumaTopology::Place(const void* data, size_t size, int id, NumaPlacement& placement)
+{
+#ifdef __linux__
+	const size_t page = size_t(sysconf(_SC_PAGESIZE));
+#else
+	const size_t page = 4096;
+#endif
+	const char* begin = static_cast<const char*>(data);
+	for (size_t offset = 0; offset < size; offset += page)
+	{
+		int n = NodeOf(begin + offset);
+		if (n < 0)
+			return;
+		placement.available = true;
+		if (n == id)
+			placement.local++;
+		else
+			placement.remote++;
+	}
+}
@@ -0,0 +1,38 @@
+#include "modes.h"
+#include "tracing.h"
+#include "polygonizer.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Polygonize the surface of the tree and write the mesh to a binary file.
+
+The grid is polygonized twice, with and without pruning the blocks of cells proven empty by the lipschitz
+bound of the tree over their box, so as to report the benefit of pruning. Both meshes should be identical.
+\param resolution number of cells along the largest side of the box of the tree
+\param blockSize number of cells along the sides of the leaf blocks
+\return false if the pruned and full meshes differ.
+*/
+bool Polygonize(int resolution, int blockSize)
+{
+	Polygonizer polygonizer(*tree, resolution, blockSize);
+	Mesh meshes[2];
+	PolygonizerStats stats[2];
+	const char* names[2] = { "pruned", "full" };
+	std::cout << std::setw(8) << "Grid" << std::setw(12) << "Cells" << std::setw(12) << "Pruned" << std::setw(12) << "Evaluated" << std::setw(10) << "Surface"
+		<< std::setw(12) << "Triangles" << std::setw(14) << "Queries" << std::setw(10) << "Prune" << std::setw(10) << "Evaluate" << std::setw(10) << "Mesh" << std::endl;
+	for (int i = 0; i < 2; i++)
+	{
+		polygonizer.Polygonize(meshes[i], stats[i], i == 0);
+		std::cout << std::setw(8) << names[i] << std::setw(12) << stats[i].cells << std::setw(12) << stats[i].prunedCells << std::setw(12) << stats[i].evaluatedCells
+			<< std::setw(10) << stats[i].surfaceCells << std::setw(12) << meshes[i].triangles.size() / 3 << std::setw(14) << stats[i].intensityQueries
+			<< std::setw(9) << int(stats[i].pruneTime * 1000.0) << "ms" << std::setw(8) << int(stats[i].evaluateTime * 1000.0) << "ms" << std::setw(8) << int(stats[i].meshTime * 1000.0) << "ms" << std::endl;
+	}
+	bool identical = meshes[0].vertices == meshes[1].vertices && meshes[0].triangles == meshes[1].triangles;
+	if (!identical)
+		std::cout << "Pruned and full meshes differ" << std::endl;
+	double speedup = (stats[1].pruneTime + stats[1].evaluateTime) / (stats[0].pruneTime + stats[0].evaluateTime);
+	std::cout << "Speedup of pruning: " << std::setprecision(3) << speedup << std::endl;
+	meshes[0].Write("mesh.bin");
+	return identical;
+}
@@ -0,0 +1,321 @@
+#include "polygonizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+static const char MeshMagic[8] = { 'B', 'L', 'O', 'B', 'M', 'S', 'H', '1' };	//!< Signature of the mesh files
+
+/*!
+\brief Write the mesh to a binary file.
+
+The file starts with a signature, followed by the number of vertices and triangles as 32 bit integers,
+the positions and normals as triplets of floats, and the vertex indexes of the triangles as 32 bit integers.
+\param path mesh file
+\return false if the file could not be written.
+*/
+bool Mesh::Write(const char* path) const
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "Unable to write mesh file " << path << std::endl;
+		return false;
+	}
+	int32_t vertexCount = int32_t(vertices.size());
+	int32_t triangleCount = int32_t(triangles.size() / 3);
+	out.write(MeshMagic, sizeof(MeshMagic));
+	out.write((const char*)&vertexCount, sizeof(int32_t));
+	out.write((const char*)&triangleCount, sizeof(int32_t));
+	std::vector<float> data(3 * vertices.size());
+	for (int i = 0; i < vertexCount; i++)
+		for (int j = 0; j < 3; j++)
+			data[3 * i + j] = float(vertices[i][j]);
+	out.write((const char*)data.data(), data.size() * sizeof(float));
+	for (int i = 0; i < vertexCount; i++)
+		for (int j = 0; j < 3; j++)
+			data[3 * i + j] = float(normals[i][j]);
+	out.write((const char*)data.data(), data.size() * sizeof(float));
+	std::vector<int32_t> indexes(triangles.begin(), triangles.end());
+	out.write((const char*)indexes.data(), indexes.size() * sizeof(int32_t));
+	return bool(out);
+}
+
+/*!
+\brief Constructor.
+\param tree the tree
+\param resolution number of cells along the largest side of the box of the tree
+\param blockSize number of cells along the sides of the leaf blocks, rounded up to a power of two
+*/
+Polygonizer::Polygonizer(const BlobTree& tree, int resolution, int blockSize) : tree(tree), blockSize(1)
+{
+	while (this->blockSize < blockSize)
+		this->blockSize *= 2;
+	Box b = tree.GetBox();
+	Vector d = b.Diagonal();
+	h = Math::Max(d[0], Math::Max(d[1], d[2])) / double(std::max(resolution, 1));
+	for (int i = 0; i < 3; i++)
+		n[i] = std::max(1, int(ceil(d[i] / h)));
+	box = Box(b[0], b[0] + h * Vector(n[0], n[1], n[2]));
+}
+
+/*!
+\brief Check whether the surface provably does not cross a block.
+\param block the block
+\param queries number of evaluations of the field, incremented
+*/
+bool Polygonizer::Prunable(const Block& block, long long& queries) const
+{
+	Box b(Vertex(block.x, block.y, block.z), Vertex(std::min(block.x + block.size, n[0]), std::min(block.y + block.size, n[1]), std::min(block.z + block.size, n[2])));
+	double f = tree.Intensity(b.Center());
+	queries++;
+	return fabs(f) > tree.K(b) * 0.5 * Norm(b.Diagonal());
+}
+
+/*!
+\brief Solve a symmetric 3x3 linear system.
+\param m upper part of the matrix, xx, xy, xz, yy, yz and zz
+\param b right hand side
+*/
+static Vector SolveSymmetric(const double m[6], const Vector& b)
+{
+	double c0 = m[3] * m[5] - m[4] * m[4];
+	double c1 = m[2] * m[4] - m[1] * m[5];
+	double c2 = m[1] * m[4] - m[2] * m[3];
+	double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+	if (fabs(det) < 1e-12)
+		return Vector(0.0);
+	double x = c0 * b[0] + c1 * b[1] + c2 * b[2];
+	double y = c1 * b[0] + (m[0] * m[5] - m[2] * m[2]) * b[1] + (m[1] * m[2] - m[0] * m[4]) * b[2];
+	double z = c2 * b[0] + (m[1] * m[2] - m[0] * m[4]) * b[1] + (m[0] * m[3] - m[1] * m[1]) * b[2];
+	return Vector(x, y, z) / det;
+}
+
+/*!
+\brief Evaluate the cells of a block and compute the vertex of the cells crossed by the surface.
+
+The vertex minimizes the squared distances to the tangent planes at the crossings of the edges, regularized
+toward the mean of the crossings, and is clamped to the cell.
+\param block the block
+\param cells returned cells crossed by the surface
+\param queries number of evaluations of the field, incremented
+*/
+void Polygonizer::Evaluate(const Block& block, std::vector<SurfaceCell>& cells, long long& queries) const
+{
+	static const int edges[12][2] = { { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+	const double lambda = 0.1;
+
+	const int sx = std::min(block.size, n[0] - block.x);
+	const int sy = std::min(block.size, n[1] - block.y);
+	const int sz = std::min(block.size, n[2] - block.z);
+	std::vector<double> values((sx + 1) * (sy + 1) * (sz + 1));
+	for (int z = 0; z <= sz; z++)
+		for (int y = 0; y <= sy; y++)
+			for (int x = 0; x <= sx; x++)
+				values[(z * (sy + 1) + y) * (sx + 1) + x] = tree.Intensity(Vertex(block.x + x, block.y + y, block.z + z));
+	queries += values.size();
+
+	for (int z = 0; z < sz; z++)
+	{
+		for (int y = 0; y < sy; y++)
+		{
+			for (int x = 0; x < sx; x++)
+			{
+				double f[8];
+				Vector p[8];
+				int corners = 0;
+				for (int c = 0; c < 8; c++)
+				{
+					int cx = x + (c & 1), cy = y + ((c >> 1) & 1), cz = z + (c >> 2);
+					f[c] = values[(cz * (sy + 1) + cy) * (sx + 1) + cx];
+					p[c] = Vertex(block.x + cx, block.y + cy, block.z + cz);
+					if (f[c] > 0.0)
+						corners |= 1 << c;
+				}
+				if (corners == 0 || corners == 255)
+					continue;
+
+				double m[6] = { lambda, 0.0, 0.0, lambda, 0.0, lambda };
+				Vector mass(0.0), normal(0.0);
+				std::vector<Vector> crossings, planes;
+				for (int e = 0; e < 12; e++)
+				{
+					int a = edges[e][0], b = edges[e][1];
+					if (((corners >> a) & 1) == ((corners >> b) & 1))
+						continue;
+					Vector q = Vector::Solve(p[a], p[b], f[a], f[b]);
+					Vector g = tree.Gradient(q);
+					queries += 6;
+					mass += q;
+					crossings.push_back(q);
+					if (SquaredNorm(g) == 0.0)
+					{
+						planes.push_back(Vector(0.0));
+						continue;
+					}
+					Vector u = Normalized(g);
+					planes.push_back(u);
+					normal -= u;
+					m[0] += u[0] * u[0];
+					m[1] += u[0] * u[1];
+					m[2] += u[0] * u[2];
+					m[3] += u[1] * u[1];
+					m[4] += u[1] * u[2];
+					m[5] += u[2] * u[2];
+				}
+				mass /= double(crossings.size());
+
+				// Solve for the offset to the mean of the crossings
+				Vector rhs(0.0);
+				for (int i = 0; i < int(crossings.size()); i++)
+					rhs += planes[i] * (planes[i] * (crossings[i] - mass));
+				SurfaceCell cell;
+				cell.index = Cell(block.x + x, block.y + y, block.z + z);
+				cell.corners = corners;
+				cell.p = Clamp(mass + SolveSymmetric(m, rhs), p[0], p[7]);
+				cell.normal = SquaredNorm(normal) > 0.0 ? Normalized(normal) : Vector(0.0, 0.0, 1.0);
+				cells.push_back(cell);
+			}
+		}
+	}
+}
+
+/*!
+\brief Polygonize the surface of the tree.
+\param mesh returned mesh
+\param stats returned statistics
+\param prune if false, every block of the grid is evaluated, which is only useful to measure the benefit of pruning
+*/
+void Polygonizer::Polygonize(Mesh& mesh, PolygonizerStats& stats, bool prune) const
+{
+	stats = PolygonizerStats();
+	stats.cells = (long long)n[0] * n[1] * n[2];
+	mesh = Mesh();
+
+	// Breadth-first traversal of the octree of blocks, whose root covers the whole grid
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int size = blockSize;
+	while (size < std::max(n[0], std::max(n[1], n[2])))
+		size *= 2;
+	std::vector<Block> frontier(1, Block{ 0, 0, 0, size });
+	std::vector<Block> leaves;
+	while (!frontier.empty())
+	{
+		std::vector<Block> next;
+		long long queries = 0, pruned = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+: queries, pruned)
+		for (int i = 0; i < int(frontier.size()); i++)
+		{
+			const Block& block = frontier[i];
+			if (prune && Prunable(block, queries))
+			{
+				pruned += (long long)std::min(block.size, n[0] - block.x) * std::min(block.size, n[1] - block.y) * std::min(block.size, n[2] - block.z);
+				continue;
+			}
+			std::vector<Block> children;
+			if (block.size == blockSize)
+				children.push_back(block);
+			else
+			{
+				int half = block.size / 2;
+				for (int c = 0; c < 8; c++)
+				{
+					Block child{ block.x + (c & 1) * half, block.y + ((c >> 1) & 1) * half, block.z + (c >> 2) * half, half };
+					if (child.x < n[0] && child.y < n[1] && child.z < n[2])
+						children.push_back(child);
+				}
+			}
+#pragma omp critical
+			{
+				std::vector<Block>& target = block.size == blockSize ? leaves : next;
+				target.insert(target.end(), children.begin(), children.end());
+			}
+		}
+		if (prune)
+			stats.blockTests += frontier.size();
+		stats.intensityQueries += queries;
+		stats.prunedCells += pruned;
+		frontier.swap(next);
+	}
+
+	// Keep the order of the vertices independent of the scheduling of the threads
+	std::sort(leaves.begin(), leaves.end(), [](const Block& a, const Block& b) { return a.z != b.z ? a.z < b.z : (a.y != b.y ? a.y < b.y : a.x < b.x); });
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	stats.pruneTime = std::chrono::duration<double>(end - begin).count();
+
+	// Evaluate the cells of the remaining blocks
+	begin = end;
+	std::vector<std::vector<SurfaceCell>> cells(leaves.size());
+	long long queries = 0, evaluated = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+: queries, evaluated)
+	for (int i = 0; i < int(leaves.size()); i++)
+	{
+		const Block& block = leaves[i];
+		evaluated += (long long)std::min(block.size, n[0] - block.x) * std::min(block.size, n[1] - block.y) * std::min(block.size, n[2] - block.z);
+		Evaluate(block, cells[i], queries);
+	}
+	stats.intensityQueries += queries;
+	stats.evaluatedCells = evaluated;
+	end = std::chrono::steady_clock::now();
+	stats.evaluateTime = std::chrono::duration<double>(end - begin).count();
+
+	// Connect the vertices of the four cells around every edge crossed by the surface
+	begin = end;
+	std::unordered_map<long long, int> vertex;
+	for (int i = 0; i < int(cells.size()); i++)
+	{
+		for (int j = 0; j < int(cells[i].size()); j++)
+		{
+			vertex[cells[i][j].index] = int(mesh.vertices.size());
+			mesh.vertices.push_back(cells[i][j].p);
+			mesh.normals.push_back(cells[i][j].normal);
+		}
+	}
+	stats.surfaceCells = mesh.vertices.size();
+
+	// Edges along x, y and z ending at the upper corner of a cell, and the cells sharing them in counter-clockwise order around the axis
+	static const int lower[3] = { 6, 5, 3 };
+	static const int around[3][4][3] = {
+		{ { 0, 0, 0 }, { 0, 1, 0 }, { 0, 1, 1 }, { 0, 0, 1 } },
+		{ { 0, 0, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 0, 0 } },
+		{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 } } };
+	for (int i = 0; i < int(cells.size()); i++)
+	{
+		for (const SurfaceCell& cell : cells[i])
+		{
+			int x = int(cell.index % n[0]);
+			int y = int((cell.index / n[0]) % n[1]);
+			int z = int(cell.index / ((long long)n[0] * n[1]));
+			bool upper = ((cell.corners >> 7) & 1) != 0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				bool inside = ((cell.corners >> lower[axis]) & 1) != 0;
+				if (inside == upper)
+					continue;
+				int quad[4];
+				bool valid = true;
+				for (int k = 0; k < 4 && valid; k++)
+				{
+					int cx = x + around[axis][k][0], cy = y + around[axis][k][1], cz = z + around[axis][k][2];
+					std::unordered_map<long long, int>::const_iterator it = vertex.end();
+					if (cx < n[0] && cy < n[1] && cz < n[2])
+						it = vertex.find(Cell(cx, cy, cz));
+					valid = it != vertex.end();
+					if (valid)
+						quad[k] = it->second;
+				}
+				if (!valid)
+					continue;
+
+				// The outside lies along the axis if the lower end of the edge is inside
+				if (!inside)
+					std::swap(quad[1], quad[3]);
+				int triangles[6] = { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] };
+				mesh.triangles.insert(mesh.triangles.end(), triangles, triangles + 6);
+			}
+		}
+	}
+	stats.meshTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
@@ -0,0 +1,140 @@
+#include "profiler.h"
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> Profiler::enabled(false);
+const std::chrono::steady_clock::time_point Profiler::start = std::chrono::steady_clock::now();
+
+static std::mutex registryMutex;								//!< Protects the registry
+static std::vector<std::unique_ptr<ProfileBuffer>> registry;	//!< Buffers of all the threads that recorded an event
+
+/*!
+\brief Enable or disable the recording of scopes.
+\param e true to enable the profiler
+*/
+void Profiler::Enable(bool e)
+{
+	enabled.store(e, std::memory_order_relaxed);
+}
+
+/*!
+\brief Buffer of the calling thread, allocated and registered on the first call of the thread.
+*/
+ProfileBuffer* Profiler::Buffer()
+{
+	thread_local ProfileBuffer* buffer = nullptr;
+	if (buffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.push_back(std::unique_ptr<ProfileBuffer>(new ProfileBuffer));
+		buffer = registry.back().get();
+		buffer->events.resize(Capacity);
+		buffer->thread = int(registry.size()) - 1;
+	}
+	return buffer;
+}
+
+/*!
+\brief Record a scope in the buffer of the calling thread, overwriting its oldest event if the buffer is full.
+\param name name of the scope
+\param begin, end start and end of the scope, see Now()
+*/
+void Profiler::Record(const char* name, int64_t begin, int64_t end)
+{
+	ProfileBuffer* buffer = Buffer();
+	buffer->events[buffer->count & (Capacity - 1)] = ProfileEvent{ name, begin, end - begin };
+	buffer->count++;
+}
+
+/*!
+\brief Remove the events of all the threads.
+*/
+void Profiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (std::unique_ptr<ProfileBuffer>& buffer : registry)
+		buffer->count = 0;
+}
+
+/*!
+\brief Number of events recorded by all the threads, including the overwritten ones.
+*/
+uint64_t Profiler::Recorded()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	uint64_t count = 0;
+	for (const std::unique_ptr<ProfileBuffer>& buffer : registry)
+		count += buffer->count;
+	return count;
+}
+
+/*!
+\brief Number of events overwritten in the ring buffers.
+*/
+uint64_t Profiler::Dropped()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	uint64_t count = 0;
+	for (const std::unique_ptr<ProfileBuffer>& buffer : registry)
+		if (buffer->count > uint64_t(Capacity))
+			count += buffer->count - Capacity;
+	return count;
+}
+
+/*!
+\brief Write the events kept in the buffers as a Chrome trace in JSON format.
+
+Every scope is a complete event, with timestamps and durations in microseconds. Threads are named
+in the order of their first event.
+\param path file path
+\return false if the file could not be written.
+*/
+bool Profiler::Export(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		std::cout << "Unable to write trace " << path << std::endl;
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(registryMutex);
+	fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	for (const std::unique_ptr<ProfileBuffer>& buffer : registry)
+	{
+		fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"Thread %d\"}}", first ? "" : ",\n", buffer->thread, buffer->thread);
+		first = false;
+		uint64_t begin = buffer->count > uint64_t(Capacity) ? buffer->count - Capacity : 0;
+		for (uint64_t i = begin; i < buffer->count; i++)
+		{
+			const ProfileEvent& e = buffer->events[i & (Capacity - 1)];
+			fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", e.name, buffer->thread, double(e.begin) * 1e-3, double(e.duration) * 1e-3);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	return fclose(fp) == 0;
+}
+
+/*!
+\brief Start a profiling session.
+\param p path of the trace, the profiler is not enabled if empty
+*/
+ProfileSession::ProfileSession(const std::string& p) : path(p)
+{
+	if (!path.empty())
+		Profiler::Enable(true);
+}
+
+/*!
+\brief End the profiling session, exporting the trace.
+*/
+ProfileSession::~ProfileSession()
+{
+	if (path.empty())
+		return;
+	Profiler::Enable(false);
+	if (Profiler::Export(path.c_str()))
+		std::cout << "Trace: " << path << ", " << Profiler::Recorded() << " events, " << Profiler::Dropped() << " dropped" << std::endl;
+}
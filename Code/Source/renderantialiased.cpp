@@ -0,0 +1,129 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Render the scene with segment tracing and adaptive anti-aliasing.
+
+A first pass traces one ray per pixel. Pixels that disagree with a neighbour in hit, depth or normal are on edges,
+and get four more rays on a rotated grid, averaged with the first one. Sub-pixel rays use the depth of the ray of
+their pixel as the first candidate segment of segment tracing. Added rays and field queries are reported against
+uniform supersampling with four rays for every pixel.
+\param field implicit field
+\param pixels, pixelsCost frame buffers
+*/
+template<typename Field>
+void RenderAntialiased(const Field* field, Vector** pixels, Vector** pixelsCost)
+{
+	const int w = settings.width;
+	const int h = settings.height;
+	const int subCount = 4;
+	const double offsets[subCount][2] = { { -0.375, -0.125 }, { 0.125, -0.375 }, { 0.375, 0.125 }, { -0.125, 0.375 } };
+	const Camera camera(settings.camera, w, h);
+	const double k = field->K();
+	std::vector<PixelSample> samples(size_t(w) * h);
+	auto at = [&](int x, int y) -> PixelSample& { return samples[size_t(y) * w + x]; };
+
+	// One ray per pixel
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int x = 0; x < w; x++)
+		for (int y = 0; y < h; y++)
+			at(x, y) = TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), k, settings.tracing);
+	double firstTime = Seconds(begin, std::chrono::steady_clock::now());
+	long long firstSteps = 0;
+	for (const PixelSample& sample : samples)
+		firstSteps += sample.steps;
+
+	// Edges
+	std::vector<std::pair<int, int>> edges;
+	for (int x = 0; x < w; x++)
+	{
+		for (int y = 0; y < h; y++)
+		{
+			bool edge = (x > 0 && Disagree(at(x, y), at(x - 1, y))) || (x + 1 < w && Disagree(at(x, y), at(x + 1, y)))
+				|| (y > 0 && Disagree(at(x, y), at(x, y - 1))) || (y + 1 < h && Disagree(at(x, y), at(x, y + 1)));
+			if (edge)
+				edges.push_back(std::make_pair(x, y));
+		}
+	}
+
+	// Sub-pixel rays on edges, with and without the hint of the pixel ray for comparison
+	long long hintedSteps = 0;
+	long long plainSteps = 0;
+	begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: hintedSteps)
+	for (int n = 0; n < int(edges.size()); n++)
+	{
+		PixelSample& pixel = at(edges[n].first, edges[n].second);
+		Vector color = pixel.color;
+		for (int j = 0; j < subCount; j++)
+		{
+			Ray ray = camera.PixelRay(edges[n].first, edges[n].second, offsets[j][0], offsets[j][1]);
+			PixelSample sub = TracePixel<SegmentBound, 100, 150, StepCount>(field, ray, k, settings.tracing, pixel.hit ? pixel.t : 0.0);
+			color += sub.color;
+			hintedSteps += sub.steps;
+		}
+		pixel.color = color / double(subCount + 1);
+	}
+	double edgeTime = Seconds(begin, std::chrono::steady_clock::now());
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: plainSteps)
+	for (int n = 0; n < int(edges.size()); n++)
+		for (int j = 0; j < subCount; j++)
+			plainSteps += TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(edges[n].first, edges[n].second, offsets[j][0], offsets[j][1]), k, settings.tracing).steps;
+
+	for (int x = 0; x < w; x++)
+	{
+		for (int y = 0; y < h; y++)
+		{
+			pixels[x][y] = at(x, y).color;
+			pixelsCost[x][y] = Vector(0);
+		}
+	}
+	for (const std::pair<int, int>& e : edges)
+		pixelsCost[e.first][e.second] = Vector(0, 255, 0);
+	if (!WriteToFile("./antialiased.ppm", pixels))
+		std::cout << "WriteToFile Error - failed to write image to disk" << std::endl;
+	if (!WriteToFile("./antialiased_edges.ppm", pixelsCost))
+		std::cout << "WriteToFile Error - failed to write edges to disk" << std::endl;
+
+	// Uniform supersampling baseline
+	long long uniformSteps = 0;
+	begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: uniformSteps)
+	for (int x = 0; x < w; x++)
+		for (int y = 0; y < h; y++)
+			for (int j = 0; j < subCount; j++)
+				uniformSteps += TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y, offsets[j][0], offsets[j][1]), k, settings.tracing).steps;
+	double uniformTime = Seconds(begin, std::chrono::steady_clock::now());
+
+	long long pixelCount = (long long)(w) * h;
+	std::cout << "Edge pixels: " << edges.size() << " (" << std::setprecision(3) << 100.0 * double(edges.size()) / double(pixelCount) << "%)" << std::endl;
+	std::cout << std::setw(10) << "" << std::setw(12) << "Rays" << std::setw(12) << "Steps" << std::setw(10) << "Time(ms)" << std::endl;
+	std::cout << std::setw(10) << "Primary" << std::setw(12) << pixelCount << std::setw(12) << firstSteps << std::setw(10) << int(1000.0 * firstTime) << std::endl;
+	std::cout << std::setw(10) << "Adaptive" << std::setw(12) << subCount * edges.size() << std::setw(12) << hintedSteps << std::setw(10) << int(1000.0 * edgeTime)
+		<< "  (" << plainSteps << " steps without the pixel depth hint)" << std::endl;
+	std::cout << std::setw(10) << "Uniform" << std::setw(12) << subCount * pixelCount << std::setw(12) << uniformSteps << std::setw(10) << int(1000.0 * uniformTime) << std::endl;
+}
+
+/*!
+\brief Render the scene with adaptive anti-aliasing with the hierarchy selected by settings.hierarchyWidth.
+\param pixels, pixelsCost frame buffers
+*/
+void RenderAntialiased(Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+	{
+		BlobTreeWide<8> wide(*tree);
+		RenderAntialiased(&wide, pixels, pixelsCost);
+	}
+	else if (settings.hierarchyWidth == 4)
+	{
+		BlobTreeWide<4> wide(*tree);
+		RenderAntialiased(&wide, pixels, pixelsCost);
+	}
+	else
+		RenderAntialiased(tree, pixels, pixelsCost);
+}
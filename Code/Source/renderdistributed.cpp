@@ -0,0 +1,269 @@
+#include "modes.h"
+#include "tracing.h"
+#include "distributed.h"
+#include "blobtreewide.h"
+#include "localsocket.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+/*!
+\brief Statistics of a distributed render.
+*/
+struct DistributedRun
+{
+	int workers = 0;		//!< Number of connected workers
+	int threads = 0;		//!< Number of render threads of all the connected workers
+	double startup = 0.0;	//!< Time from the launch of the workers to their last connection
+	double load = 0.0;		//!< Longest time spent by a worker reading the binary cache
+	double render = 0.0;	//!< Time from the first sent tile to the last received one
+	int minTiles = 0;		//!< Least number of tiles rendered by a worker
+	int maxTiles = 0;		//!< Largest number of tiles rendered by a worker
+	bool complete = false;	//!< False if some tiles were not rendered
+};
+
+/*!
+\brief Path of a file shared by the coordinator of a distributed render and its workers, in the working directory.
+
+The name includes the identifier of the coordinator process, so that concurrent renders do not collide.
+\param name base name of the file
+\param extension extension of the file
+*/
+std::string DistributedPath(const char* name, const char* extension)
+{
+	return std::string("./") + name + "-" + std::to_string(LocalProcess::Id()) + extension;
+}
+
+/*!
+\brief Render a frame with worker processes, each loading the hierarchy from the binary cache.
+
+The coordinator launches the workers, waits for their connection, and keeps two tiles in flight per worker
+so that a worker never waits for its next tile. Every worker identifies itself by its index when it connects,
+and the coordinator accepts one connection per launched worker. Tiles are handed out in order as results come
+back, so that fast workers render more tiles. The tiles in flight of a worker whose connection is lost are handed out again.
+\param workers number of worker processes
+\param threads number of render threads of every worker
+\param tileSize side of the square tiles
+\param cache binary cache of the hierarchy, see BlobTreeWide::Write()
+\param colors, costs returned image, row by row
+*/
+DistributedRun RenderDistributed(int workers, int threads, int tileSize, const std::string& cache, std::vector<Vector>& colors, std::vector<Vector>& costs)
+{
+	const int inFlight = 2;
+	const int timeout = 30000;
+	DistributedRun run;
+	const std::string socket = DistributedPath("distributed", ".sock");
+	int listener = LocalSocket::Listen(socket.c_str(), workers);
+	if (listener < 0)
+	{
+		std::remove(socket.c_str());
+		return run;
+	}
+
+	// Workers run the same executable with the same settings
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<std::string> args = settings.Arguments();
+	args.insert(args.begin(), "SegmentTracing");
+	args.insert(args.end(), { "--worker", socket, cache, "" });
+	std::vector<int> processes;
+	int spawned = 0;
+	for (int i = 0; i < workers; i++)
+	{
+		args.back() = std::to_string(i);
+		processes.push_back(LocalProcess::Spawn(args, threads));
+		spawned += processes.back() >= 0;
+	}
+
+	// One connection per launched worker, identified by its index rather than by the order of the connections
+	std::vector<int> sockets;
+	std::vector<bool> connected(workers, false);
+	for (int i = 0; i < spawned; i++)
+	{
+		DistributedHello hello;
+		int s = LocalSocket::Accept(listener, timeout);
+		if (s < 0)
+			break;
+		if (!LocalSocket::Receive(s, &hello, sizeof(hello)) || hello.id < 0 || hello.id >= workers || processes[hello.id] < 0 || connected[hello.id])
+		{
+			LocalSocket::Close(s);
+			continue;
+		}
+		connected[hello.id] = true;
+		run.load = max(run.load, hello.load);
+		run.threads += hello.threads;
+		sockets.push_back(s);
+	}
+	LocalSocket::Close(listener);
+	std::remove(socket.c_str());
+	run.workers = int(sockets.size());
+	run.startup = Seconds(begin, std::chrono::steady_clock::now());
+
+	std::deque<DistributedTile> queue;
+	for (int y = 0; y < settings.height; y += tileSize)
+		for (int x = 0; x < settings.width; x += tileSize)
+			queue.push_back(DistributedTile{ x, y, min(tileSize, settings.width - x), min(tileSize, settings.height - y) });
+	const int tiles = int(queue.size());
+	colors.assign(size_t(settings.width) * settings.height, Vector(0));
+	costs.assign(size_t(settings.width) * settings.height, Vector(0));
+
+	// Hand out the tiles, a lost worker gives its tiles back
+	begin = std::chrono::steady_clock::now();
+	std::vector<std::deque<DistributedTile>> pending(sockets.size());
+	std::vector<int> rendered(sockets.size(), 0);
+	auto lose = [&](int w)
+	{
+		queue.insert(queue.begin(), pending[w].begin(), pending[w].end());
+		pending[w].clear();
+		LocalSocket::Close(sockets[w]);
+		sockets[w] = -1;
+	};
+	auto dispatch = [&](int w)
+	{
+		while (sockets[w] >= 0 && int(pending[w].size()) < inFlight && !queue.empty())
+		{
+			pending[w].push_back(queue.front());
+			queue.pop_front();
+			if (!LocalSocket::Send(sockets[w], &pending[w].back(), sizeof(DistributedTile)))
+				lose(w);
+		}
+	};
+	for (int w = 0; w < int(sockets.size()); w++)
+		dispatch(w);
+	std::vector<Vector> tileColors;
+	std::vector<Vector> tileCosts;
+	int received = 0;
+	while (received < tiles && std::count(sockets.begin(), sockets.end(), -1) < int(sockets.size()))
+	{
+		int w = LocalSocket::Wait(sockets, timeout);
+		if (w < 0)
+			break;
+		DistributedTile tile;
+		bool valid = LocalSocket::Receive(sockets[w], &tile, sizeof(tile)) && !pending[w].empty() && tile.x == pending[w].front().x && tile.y == pending[w].front().y
+			&& tile.w == pending[w].front().w && tile.h == pending[w].front().h;
+		if (valid)
+		{
+			tileColors.resize(size_t(tile.w) * tile.h);
+			tileCosts.resize(size_t(tile.w) * tile.h);
+			valid = LocalSocket::Receive(sockets[w], tileColors.data(), tileColors.size() * sizeof(Vector)) && LocalSocket::Receive(sockets[w], tileCosts.data(), tileCosts.size() * sizeof(Vector));
+		}
+		if (!valid)
+		{
+			lose(w);
+			for (int v = 0; v < int(sockets.size()); v++)
+				dispatch(v);
+			continue;
+		}
+		for (int j = 0; j < tile.h; j++)
+		{
+			std::copy(tileColors.begin() + j * tile.w, tileColors.begin() + (j + 1) * tile.w, colors.begin() + size_t(tile.y + j) * settings.width + tile.x);
+			std::copy(tileCosts.begin() + j * tile.w, tileCosts.begin() + (j + 1) * tile.w, costs.begin() + size_t(tile.y + j) * settings.width + tile.x);
+		}
+		pending[w].pop_front();
+		rendered[w]++;
+		received++;
+		dispatch(w);
+	}
+	run.render = Seconds(begin, std::chrono::steady_clock::now());
+	run.complete = received == tiles;
+
+	const DistributedTile quit = { 0, 0, 0, 0 };
+	for (int s : sockets)
+	{
+		if (s >= 0)
+			LocalSocket::Send(s, &quit, sizeof(quit));
+		LocalSocket::Close(s);
+	}
+	for (int p : processes)
+		LocalProcess::Join(p);
+	if (!rendered.empty())
+	{
+		run.minTiles = *std::min_element(rendered.begin(), rendered.end());
+		run.maxTiles = *std::max_element(rendered.begin(), rendered.end());
+	}
+	return run;
+}
+
+/*!
+\brief Render the scene with an increasing number of worker processes, and report the scaling efficiency.
+
+The wide hierarchy is written to a binary cache once, and every worker loads it instead of building the hierarchy
+from the particle file. Every worker has the same number of threads in every run, the hardware threads divided by
+the largest number of workers, so that the efficiency compares runs with the same threads per worker. The frame
+rendered by the workers is compared to a frame rendered by this process, and the image assembled by the last run
+is written to distributed.ppm. The binary cache is named after this process and removed when done.
+\param wide the hierarchy
+\param maxWorkers largest number of workers, runs double the number of workers from one up to this number
+\param tileSize side of the square tiles
+\param pixels, pixelsCost frame buffers
+\return false if a run did not render every tile, or if its frame differs from the frame rendered by this process.
+*/
+template<int W>
+bool RenderDistributed(const BlobTreeWide<W>& wide, int maxWorkers, int tileSize, Vector** pixels, Vector** pixelsCost)
+{
+	const std::string cache = DistributedPath("scene", ".cache");
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	if (!wide.Write(cache.c_str()))
+	{
+		std::remove(cache.c_str());
+		return false;
+	}
+	std::cout << "Binary cache: " << int(1000.0 * Seconds(begin, std::chrono::steady_clock::now())) << "ms, "
+		<< (wide.GetNodes().size() * sizeof(BlobTreeWideNode<W>) + wide.GetPoints().Memory()) / 1024 << "KB" << std::endl;
+
+	begin = std::chrono::steady_clock::now();
+	RenderFrame(&wide, RayTraceMethod::SegmentTracing, wide.K(), pixels, pixelsCost);
+	double local = Seconds(begin, std::chrono::steady_clock::now());
+	std::cout << "Local render: " << int(1000.0 * local) << "ms, " << omp_get_max_threads() << " threads, tiles of " << tileSize << " pixels" << std::endl;
+
+	std::cout << std::setw(8) << "Workers" << std::setw(9) << "Threads" << std::setw(10) << "Startup" << std::setw(8) << "Load"
+		<< std::setw(10) << "Render" << std::setw(9) << "Speedup" << std::setw(12) << "Efficiency" << std::setw(11) << "Tiles" << std::setw(8) << "Differ" << std::endl;
+	std::vector<Vector> colors;
+	std::vector<Vector> costs;
+	const int threads = max(1, int(std::thread::hardware_concurrency()) / maxWorkers);
+	double single = 0.0;
+	bool identical = true;
+	for (int workers = 1; workers <= maxWorkers; workers = workers < maxWorkers ? min(2 * workers, maxWorkers) : maxWorkers + 1)
+	{
+		DistributedRun run = RenderDistributed(workers, threads, tileSize, cache, colors, costs);
+		if (!run.complete)
+		{
+			std::cout << std::setw(8) << workers << "  failed, " << run.workers << " workers connected" << std::endl;
+			identical = false;
+			break;
+		}
+		if (workers == 1)
+			single = run.render;
+		int differ = 0;
+		for (int x = 0; x < settings.width; x++)
+			for (int y = 0; y < settings.height; y++)
+				differ += colors[size_t(y) * settings.width + x] != pixels[x][y] || costs[size_t(y) * settings.width + x] != pixelsCost[x][y];
+		std::ostringstream tiles;
+		tiles << run.minTiles << "-" << run.maxTiles;
+		std::cout << std::setw(8) << run.workers << std::setw(9) << run.threads << std::setw(8) << int(1000.0 * run.startup) << "ms" << std::setw(6) << int(1000.0 * run.load) << "ms"
+			<< std::setw(8) << int(1000.0 * run.render) << "ms" << std::setw(9) << std::setprecision(3) << single / run.render
+			<< std::setw(11) << std::setprecision(3) << 100.0 * single / (run.render * run.workers) << "%" << std::setw(11) << tiles.str() << std::setw(8) << differ << std::endl;
+		identical = identical && differ == 0;
+	}
+	std::remove(cache.c_str());
+	if (!colors.empty() && !WriteToFile("./distributed.ppm", colors, settings.width, settings.height))
+		std::cout << "WriteToFile Error - failed to write the distributed render to disk" << std::endl;
+	return identical;
+}
+
+/*!
+\brief Render the scene with worker processes with the wide hierarchy selected by settings.hierarchyWidth.
+\param maxWorkers largest number of workers
+\param tileSize side of the square tiles
+\param pixels, pixelsCost frame buffers
+\return false if a run did not render every tile, or if its frame differs from the frame rendered by this process.
+*/
+bool RenderDistributed(int maxWorkers, int tileSize, Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+		return RenderDistributed(BlobTreeWide<8>(*tree), maxWorkers, tileSize, pixels, pixelsCost);
+	return RenderDistributed(BlobTreeWide<4>(*tree), maxWorkers, tileSize, pixels, pixelsCost);
+}
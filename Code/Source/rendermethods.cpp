@@ -0,0 +1,82 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include "blobtreequantized.h"
+#include <iostream>
+
+/*!
+\brief Render the scene with the raytracing method of the settings, or all of them, and output images to ppm files.
+\param field implicit field
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param pixels, pixelsCost frame buffers
+*/
+template<typename Field>
+void RenderMethods(const Field* field, double k, Vector** pixels, Vector** pixelsCost)
+{
+	for (int l = 0; l < RayTraceMethod::COUNT; l++)
+	{
+		if (settings.method >= 0 && l != settings.method)
+			continue;
+		RayTraceMethod method = (RayTraceMethod)l;
+
+		// Compute pixels
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		RenderFrame(field, method, k, pixels, pixelsCost);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		// Print stats
+		std::cout << ((l == 0) ? "SphereTracing" : (l == 1) ? "Enhanced Sphere Tracing" : "Segment Tracing") << std::endl;
+		long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+		int seconds = int(double(milliseconds) / 1000.0);
+		std::cout << "Time: " << seconds << "s" << milliseconds % 1000 << "ms" << std::endl;
+
+		// Output to ppm files
+		char path[40];
+		char pathCost[40];
+		sprintf(path, "./render%d.ppm", l);
+		sprintf(pathCost, "./render%d_cost.ppm", l);
+		if (!WriteToFile(path, pixels))
+			std::cout << "WriteToFile Error - failed to write file 1 to disk" << std::endl;
+		if (!WriteToFile(pathCost, pixelsCost))
+			std::cout << "WriteToFile Error - failed to write file 2 to disk" << std::endl;
+	}
+}
+
+/*!
+\brief Render the scene using a wide hierarchy, compressed if settings.quantizationBits is 8 or 16.
+\param k global lipschitz constant used for sphere tracing and enhanced sphere tracing
+\param pixels, pixelsCost frame buffers
+*/
+template<int W>
+void RenderMethods(double k, Vector** pixels, Vector** pixelsCost)
+{
+	BlobTreeWide<W> wide(*tree);
+	if (settings.quantizationBits == 8)
+	{
+		BlobTreeQuantized<W, uint8_t> quantized(wide);
+		RenderMethods(&quantized, k, pixels, pixelsCost);
+	}
+	else if (settings.quantizationBits == 16)
+	{
+		BlobTreeQuantized<W, uint16_t> quantized(wide);
+		RenderMethods(&quantized, k, pixels, pixelsCost);
+	}
+	else
+		RenderMethods(&wide, k, pixels, pixelsCost);
+}
+
+/*!
+\brief Render the scene with the hierarchy selected by settings.hierarchyWidth and settings.quantizationBits.
+\param pixels, pixelsCost frame buffers
+*/
+void RenderMethods(Vector** pixels, Vector** pixelsCost)
+{
+	// Global Lipschitz constant for sphere tracing and enhanced sphere tracing
+	const double k = tree->K();
+	if (settings.hierarchyWidth == 8)
+		RenderMethods<8>(k, pixels, pixelsCost);
+	else if (settings.hierarchyWidth == 4)
+		RenderMethods<4>(k, pixels, pixelsCost);
+	else
+		RenderMethods(tree, k, pixels, pixelsCost);
+}
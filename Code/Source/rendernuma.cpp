@@ -0,0 +1,154 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include "numatopology.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+/*!
+\brief Count the pages of a wide hierarchy and of its primitives on a node and on the other nodes.
+\param wide the hierarchy
+\param id identifier of the expected node, see NumaTopology::Id()
+\param placement returned counts, accumulated with those of previous hierarchies
+*/
+template<int W>
+void PlaceHierarchy(const BlobTreeWide<W>& wide, int id, NumaPlacement& placement)
+{
+	const std::vector<BlobTreeWideNode<W>>& nodes = wide.GetNodes();
+	NumaTopology::Place(nodes.data(), nodes.size() * sizeof(BlobTreeWideNode<W>), id, placement);
+	const PointBuffer& points = wide.GetPoints();
+	const std::vector<double>* arrays[] = { &points.cx, &points.cy, &points.cz, &points.r, &points.e, &points.rr, &points.rr5, &points.kmax, &points.e6 };
+	for (const std::vector<double>* a : arrays)
+		NumaTopology::Place(a->data(), a->size() * sizeof(double), id, placement);
+}
+
+/*!
+\brief Render the scene with segment tracing on a wide hierarchy replicated in the memory of every NUMA node.
+
+A thread pinned on a processor of every node copies the primitives and the nodes of the hierarchy, so that the
+replica is allocated on that node. Render threads are pinned on every processor, and trace the tiles handed out to
+their node before stealing tiles from the other nodes. The frame is rendered with OpenMP threads and the shared
+hierarchy, with pinned threads and the shared hierarchy, and with pinned threads and the replicas. Time, the pages of
+the hierarchies on the node of the threads using them where available, and the pixels that differ from the first
+frame are reported.
+\param wide the hierarchy
+\param pixels, pixelsCost frame buffers
+*/
+template<int W>
+void RenderNuma(const BlobTreeWide<W>& wide, Vector** pixels, Vector** pixelsCost)
+{
+	const int tileSize = 16;
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	const NumaTopology topology;
+	const int nodes = topology.Nodes();
+	int threads = 0;
+	for (int n = 0; n < nodes; n++)
+		threads += int(topology.Cpus(n).size());
+	std::cout << "NUMA nodes: " << nodes << ", processors:";
+	for (int n = 0; n < nodes; n++)
+		std::cout << " " << topology.Cpus(n).size();
+	std::cout << std::endl;
+
+	// Reference frame
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	RenderFrame<SegmentBound, 100, 150, StepCount>(&wide, wide.K(), pixels, pixelsCost);
+	double reference = Seconds(begin, std::chrono::steady_clock::now());
+
+	// Replicas, copied by a thread pinned on every node
+	begin = std::chrono::steady_clock::now();
+	std::vector<std::unique_ptr<PointBuffer>> points(nodes);
+	std::vector<std::unique_ptr<BlobTreeWide<W>>> replicas(nodes);
+	std::vector<std::thread> builders;
+	for (int n = 0; n < nodes; n++)
+	{
+		builders.push_back(std::thread([&, n]()
+		{
+			NumaTopology::Pin(topology.Cpus(n)[0]);
+			points[n].reset(new PointBuffer(wide.GetPoints()));
+			replicas[n].reset(new BlobTreeWide<W>(wide, points[n].get()));
+		}));
+	}
+	for (std::thread& builder : builders)
+		builder.join();
+	double replication = Seconds(begin, std::chrono::steady_clock::now());
+
+	// Tiles are split in a contiguous range per node
+	const int tw = (w + tileSize - 1) / tileSize;
+	const int tiles = tw * ((h + tileSize - 1) / tileSize);
+	std::vector<Vector> colors(size_t(w) * h);
+	std::cout << std::setw(26) << "Configuration" << std::setw(10) << "Render" << std::setw(14) << "Local pages" << std::setw(10) << "Differ" << std::endl;
+	std::cout << std::setw(26) << "OpenMP, shared" << std::setw(8) << int(1000.0 * reference) << "ms" << std::setw(14) << "-" << std::setw(10) << 0 << std::endl;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		std::unique_ptr<std::atomic<int>[]> next(new std::atomic<int>[nodes]);
+		for (int n = 0; n < nodes; n++)
+			next[n] = n * tiles / nodes;
+		begin = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (int n = 0; n < nodes; n++)
+		{
+			for (int cpu : topology.Cpus(n))
+			{
+				workers.push_back(std::thread([&, n, cpu]()
+				{
+					NumaTopology::Pin(cpu);
+					const BlobTreeWide<W>* field = pass == 0 ? &wide : replicas[n].get();
+					for (int m = 0; m < nodes; m++)
+					{
+						const int node = (n + m) % nodes;
+						const int end = (node + 1) * tiles / nodes;
+						for (int t = next[node]++; t < end; t = next[node]++)
+						{
+							const int x0 = (t % tw) * tileSize;
+							const int y0 = (t / tw) * tileSize;
+							for (int x = x0; x < min(x0 + tileSize, w); x++)
+							{
+								for (int y = y0; y < min(y0 + tileSize, h); y++)
+								{
+									Vector cost;
+									PixelColor<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), field->K(), settings.tracing, colors[size_t(y) * w + x], cost);
+								}
+							}
+						}
+					}
+				}));
+			}
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+		double time = Seconds(begin, std::chrono::steady_clock::now());
+
+		// Pages of the hierarchy used by every thread on the node of the thread
+		NumaPlacement placement;
+		for (int n = 0; n < nodes; n++)
+			for (int i = 0; i < int(topology.Cpus(n).size()); i++)
+				PlaceHierarchy(pass == 0 ? wide : *replicas[n], topology.Id(n), placement);
+		int differ = 0;
+		for (int x = 0; x < w; x++)
+			for (int y = 0; y < h; y++)
+				differ += colors[size_t(y) * w + x] != pixels[x][y];
+		std::ostringstream local;
+		if (placement.available)
+			local << std::setprecision(3) << 100.0 * double(placement.local) / double(placement.local + placement.remote) << "%";
+		else
+			local << "n/a";
+		std::cout << std::setw(26) << (pass == 0 ? "Pinned, shared" : "Pinned, replicated") << std::setw(8) << int(1000.0 * time) << "ms" << std::setw(14) << local.str() << std::setw(10) << differ << std::endl;
+	}
+	std::cout << "Replication: " << int(1000.0 * replication) << "ms, " << nodes * (wide.GetNodes().size() * sizeof(BlobTreeWideNode<W>) + wide.GetPoints().Memory()) / 1024 << "KB" << std::endl;
+}
+
+/*!
+\brief Render the scene on every NUMA node with the wide hierarchy selected by settings.hierarchyWidth.
+\param pixels, pixelsCost frame buffers
+*/
+void RenderNuma(Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+		RenderNuma(BlobTreeWide<8>(*tree), pixels, pixelsCost);
+	else
+		RenderNuma(BlobTreeWide<4>(*tree), pixels, pixelsCost);
+}
@@ -0,0 +1,98 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Render the scene with segment tracing skipping the empty space classified by octrees of increasing depth.
+
+Octrees are built from the BlobTree, whose lipschitz bound over boxes is conservative for every hierarchy.
+Nodes, leaves, memory and construction time are reported for every depth, together with the steps and time
+of segment tracing and the number of pixels whose hit differs from plain segment tracing.
+\param field implicit field
+\param maxDepth maximum depth of the octrees
+\param pixels, pixelsCost frame buffers
+*/
+template<typename Field>
+void RenderOctree(const Field* field, int maxDepth, Vector** pixels, Vector** pixelsCost)
+{
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	std::vector<double> depths(w * h);
+	std::vector<char> hits(w * h);
+
+	// Plain segment tracing, shaded as well for a fair comparison
+	long long steps = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: steps)
+	for (int x = 0; x < w; x++)
+	{
+		for (int y = 0; y < h; y++)
+		{
+			PixelSample sample = TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), 0.0, settings.tracing);
+			hits[x * h + y] = sample.hit;
+			depths[x * h + y] = sample.t;
+			steps += sample.steps;
+		}
+	}
+	double time = Seconds(begin, std::chrono::steady_clock::now());
+
+	std::cout << std::setw(6) << "Depth" << std::setw(10) << "Nodes" << std::setw(10) << "Empty" << std::setw(10) << "Full" << std::setw(10) << "Surface"
+		<< std::setw(12) << "Memory(KB)" << std::setw(10) << "Build" << std::setw(12) << "Steps" << std::setw(10) << "Render" << std::setw(10) << "Differ" << std::endl;
+	std::cout << std::setw(6) << "-" << std::setw(72) << steps << std::setw(8) << int(1000.0 * time) << "ms" << std::endl;
+	for (int depth = 2; depth <= maxDepth; depth += 2)
+	{
+		SpaceOctree octree(*tree, depth);
+		SpaceOctreeStats stats = octree.Stats();
+		steps = 0;
+		int differ = 0;
+		begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 16) reduction(+: steps, differ)
+		for (int x = 0; x < w; x++)
+		{
+			for (int y = 0; y < h; y++)
+			{
+				Ray ray = camera.PixelRay(x, y);
+				double t = 0.0;
+				int s = 0;
+				bool hit = TraceOctree<150, StepCount>(field, &octree, ray, settings.tracing, t, s);
+				steps += s;
+				if (hit != bool(hits[x * h + y]) || (hit && fabs(t - depths[x * h + y]) > 0.01))
+					differ++;
+				pixels[x][y] = hit ? Vector(255 * Math::Max(-Normalized(field->Gradient(ray(t))) * sunDir, 0.1), 0, 0) : Vector(0);
+				pixelsCost[x][y] = Vector(0, Math::Min(double(s) / 512.0, 1.0) * 255.0, 0);
+			}
+		}
+		time = Seconds(begin, std::chrono::steady_clock::now());
+		std::cout << std::setw(6) << stats.depth << std::setw(10) << stats.nodes << std::setw(10) << stats.leaves[EmptySpace] << std::setw(10) << stats.leaves[FullSpace]
+			<< std::setw(10) << stats.leaves[SurfaceSpace] << std::setw(12) << stats.memory / 1024 << std::setw(8) << int(1000.0 * stats.buildTime) << "ms"
+			<< std::setw(12) << steps << std::setw(8) << int(1000.0 * time) << "ms" << std::setw(10) << differ << std::endl;
+	}
+	if (!WriteToFile("./render_octree.ppm", pixels))
+		std::cout << "Unable to write render_octree.ppm" << std::endl;
+	if (!WriteToFile("./render_octree_cost.ppm", pixelsCost))
+		std::cout << "Unable to write render_octree_cost.ppm" << std::endl;
+}
+
+/*!
+\brief Render the scene skipping empty space with the hierarchy selected by settings.hierarchyWidth.
+\param maxDepth maximum depth of the octree
+\param pixels, pixelsCost frame buffers
+*/
+void RenderOctree(int maxDepth, Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+	{
+		BlobTreeWide<8> wide(*tree);
+		RenderOctree(&wide, maxDepth, pixels, pixelsCost);
+	}
+	else if (settings.hierarchyWidth == 4)
+	{
+		BlobTreeWide<4> wide(*tree);
+		RenderOctree(&wide, maxDepth, pixels, pixelsCost);
+	}
+	else
+		RenderOctree(tree, maxDepth, pixels, pixelsCost);
+}
@@ -0,0 +1,64 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreechunked.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Convert the particle file of the scene into an out-of-core scene file.
+
+All the particles are loaded, since BlobTreeChunked::Write() partitions them in memory, but neither the tree of the
+scene nor the trees of the chunks are built.
+\param path scene file to write
+\param chunkSize maximum number of particles per chunk
+\return false if the particles could not be read or the file could not be written.
+*/
+bool ConvertChunks(const char* path, int chunkSize)
+{
+	if (chunkSize < 1)
+	{
+		std::cout << "Usage: --chunk chunkSize path" << std::endl;
+		return false;
+	}
+	std::vector<Vector> centers;
+	if (!BlobTree::Load(settings.scene.c_str(), centers))
+		return false;
+	if (!BlobTreeChunked::Write(path, centers, 2.25, chunkSize))	// Hardcoded radius for the files
+		return false;
+	std::cout << "Particles: " << centers.size() << ", chunk size: " << chunkSize << ", written to " << path << std::endl;
+	return true;
+}
+
+/*!
+\brief Render an out-of-core scene file with segment tracing.
+
+Only the top-level tree of the file is loaded, the chunks touched by the queries being resident under a memory cap,
+so that scenes larger than the memory can be rendered. The scene file is written by ConvertChunks().
+\param path scene file
+\param memoryCap maximum memory used by resident chunks, in bytes
+\param pixels, pixelsCost frame buffers
+\return false if the scene file could not be read.
+*/
+bool RenderOutOfCore(const char* path, size_t memoryCap, Vector** pixels, Vector** pixelsCost)
+{
+	BlobTreeChunked chunked(path, memoryCap, settings.leafSize);
+	if (!chunked.IsValid())
+		return false;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	RenderFrame(&chunked, RayTraceMethod::SegmentTracing, chunked.K(), pixels, pixelsCost);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	if (!chunked.IsValid())
+	{
+		std::cout << "Chunks of " << path << " could not be read, the render is incomplete" << std::endl;
+		return false;
+	}
+	if (!WriteToFile("./render_chunked.ppm", pixels))
+		std::cout << "WriteToFile Error - failed to write image to disk" << std::endl;
+
+	ChunkCacheStats stats = chunked.CacheStats();
+	std::cout << "Chunks: " << chunked.ChunkCount() << ", memory cap: " << memoryCap / 1024 << "KB, peak resident: " << stats.peak / 1024 << "KB" << std::endl;
+	std::cout << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms" << std::endl;
+	std::cout << "Hit rate: " << std::setprecision(4) << 100.0 * stats.HitRate() << "% (" << stats.hits << " hits, " << stats.misses << " misses), evictions: " << stats.evictions
+		<< ", read: " << stats.bytesRead / 1024 << "KB" << std::endl;
+	return true;
+}
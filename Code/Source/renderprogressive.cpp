@@ -0,0 +1,187 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Render the scene progressively with segment tracing, from a coarse subsample to the full resolution.
+
+The first pass traces every 8th pixel along both axes. Every following pass halves the spacing: the pixels
+of a block whose corner samples disagree in hit, depth or normal are traced, the others are interpolated from
+the corners. The partial image is written after every pass, each pixel taking the value of the closest
+sample on the grid of the pass. Time to the first image and to the converged image are reported, as well as
+the traced ray count and the pixels differing from a full render.
+\param field implicit field
+\param pixels, pixelsCost frame buffers
+*/
+template<typename Field>
+void RenderProgressive(const Field* field, Vector** pixels, Vector** pixelsCost)
+{
+	const int coarse = 8;
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	const double k = field->K();
+	std::vector<PixelSample> samples(size_t(w) * h);
+	std::vector<char> traced(size_t(w) * h, 0);
+	auto at = [&](int x, int y) -> PixelSample& { return samples[size_t(y) * w + x]; };
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	double firstImage = 0.0;
+	long long tracedCount = 0;
+	for (int step = coarse, pass = 0; step >= 1; step /= 2, pass++)
+	{
+		std::vector<std::pair<int, int>> trace;
+		std::vector<std::pair<int, int>> interpolate;
+		if (step == coarse)
+		{
+			for (int y = 0; y < h; y += step)
+				for (int x = 0; x < w; x += step)
+					trace.push_back(std::make_pair(x, y));
+		}
+		else
+		{
+			// Blocks of the previous pass whose existing corners disagree
+			const int previous = 2 * step;
+			const int bw = (w - 1) / previous + 1;
+			const int bh = (h - 1) / previous + 1;
+			std::vector<char> refine(size_t(bw) * bh, 0);
+			for (int by = 0; by < bh; by++)
+			{
+				for (int bx = 0; bx < bw; bx++)
+				{
+					const PixelSample* corners[4];
+					int n = 0;
+					for (int c = 0; c < 4; c++)
+					{
+						int x = (bx + (c & 1)) * previous;
+						int y = (by + (c >> 1)) * previous;
+						if (x < w && y < h)
+							corners[n++] = &at(x, y);
+					}
+					for (int a = 0; a < n && !refine[by * bw + bx]; a++)
+						for (int b = a + 1; b < n; b++)
+							if (Disagree(*corners[a], *corners[b]))
+								refine[by * bw + bx] = 1;
+				}
+			}
+
+			// New samples of a block lie on its top and left edges and at its center, edge samples are shared with a neighbour block
+			for (int by = 0; by < bh; by++)
+			{
+				for (int bx = 0; bx < bw; bx++)
+				{
+					const int x = bx * previous;
+					const int y = by * previous;
+					const bool self = refine[by * bw + bx] != 0;
+					const bool above = by > 0 && refine[(by - 1) * bw + bx] != 0;
+					const bool left = bx > 0 && refine[by * bw + bx - 1] != 0;
+					if (x + step < w)
+						(self || above ? trace : interpolate).push_back(std::make_pair(x + step, y));
+					if (y + step < h)
+						(self || left ? trace : interpolate).push_back(std::make_pair(x, y + step));
+					if (x + step < w && y + step < h)
+						(self ? trace : interpolate).push_back(std::make_pair(x + step, y + step));
+				}
+			}
+		}
+
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int n = 0; n < int(trace.size()); n++)
+		{
+			const int x = trace[n].first;
+			const int y = trace[n].second;
+			at(x, y) = TracePixel<SegmentBound, 100, 150, StepCount>(field, camera.PixelRay(x, y), k, settings.tracing);
+			traced[size_t(y) * w + x] = 1;
+		}
+
+		// Interpolated samples average the samples of the previous pass they lie between, which agree
+		for (const std::pair<int, int>& p : interpolate)
+		{
+			const int x = p.first;
+			const int y = p.second;
+			const int x0 = x - x % (2 * step);
+			const int y0 = y - y % (2 * step);
+			const int x1 = (x == x0 || x0 + 2 * step >= w) ? x0 : x0 + 2 * step;
+			const int y1 = (y == y0 || y0 + 2 * step >= h) ? y0 : y0 + 2 * step;
+			const PixelSample* parents[4] = { &at(x0, y0), &at(x1, y0), &at(x0, y1), &at(x1, y1) };
+			PixelSample& sample = at(x, y);
+			sample = *parents[0];
+			sample.t = 0.0;
+			sample.normal = sample.color = Vector(0);
+			for (const PixelSample* parent : parents)
+			{
+				sample.t += 0.25 * parent->t;
+				sample.normal += parent->normal;
+				sample.color += 0.25 * parent->color;
+			}
+			if (sample.hit)
+				sample.normal = Normalized(sample.normal);
+		}
+		tracedCount += trace.size();
+
+		// Publish the partial image
+		for (int x = 0; x < w; x++)
+			for (int y = 0; y < h; y++)
+				pixels[x][y] = at(x - x % step, y - y % step).color;
+		char path[40];
+		sprintf(path, "./progressive%d.ppm", pass);
+		if (!WriteToFile(path, pixels))
+			std::cout << "WriteToFile Error - failed to write pass " << pass << " to disk" << std::endl;
+		double elapsed = Seconds(begin, std::chrono::steady_clock::now());
+		if (pass == 0)
+			firstImage = elapsed;
+		std::cout << "Pass " << pass << " (spacing " << step << "): traced " << trace.size() << ", interpolated " << interpolate.size() << ", " << int(1000.0 * elapsed) << "ms" << std::endl;
+	}
+	double converged = Seconds(begin, std::chrono::steady_clock::now());
+
+	// Traced pixels, and comparison with a full render
+	Vector** progressive = new Vector * [w];
+	for (int x = 0; x < w; x++)
+	{
+		progressive[x] = new Vector[h];
+		for (int y = 0; y < h; y++)
+		{
+			progressive[x][y] = pixels[x][y];
+			pixelsCost[x][y] = traced[size_t(y) * w + x] ? Vector(0, 255, 0) : Vector(0);
+		}
+	}
+	if (!WriteToFile("./progressive_traced.ppm", pixelsCost))
+		std::cout << "WriteToFile Error - failed to write traced pixels to disk" << std::endl;
+	begin = std::chrono::steady_clock::now();
+	RenderFrame(field, RayTraceMethod::SegmentTracing, k, pixels, pixelsCost);
+	double full = Seconds(begin, std::chrono::steady_clock::now());
+	int differing = 0;
+	for (int x = 0; x < w; x++)
+	{
+		for (int y = 0; y < h; y++)
+			differing += int(pixels[x][y][0]) != int(progressive[x][y][0]) || int(pixels[x][y][1]) != int(progressive[x][y][1]) || int(pixels[x][y][2]) != int(progressive[x][y][2]);
+		delete[] progressive[x];
+	}
+	delete[] progressive;
+
+	std::cout << "Time to first image: " << int(1000.0 * firstImage) << "ms, to converged image: " << int(1000.0 * converged) << "ms" << std::endl;
+	std::cout << "Traced rays: " << tracedCount << " (" << std::setprecision(3) << 100.0 * double(tracedCount) / (double(w) * h) << "% of the pixels)" << std::endl;
+	std::cout << "Full render: " << int(1000.0 * full) << "ms, differing pixels: " << differing << std::endl;
+}
+
+/*!
+\brief Render the scene coarse to fine with the hierarchy selected by settings.hierarchyWidth.
+\param pixels, pixelsCost frame buffers
+*/
+void RenderProgressive(Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+	{
+		BlobTreeWide<8> wide(*tree);
+		RenderProgressive(&wide, pixels, pixelsCost);
+	}
+	else if (settings.hierarchyWidth == 4)
+	{
+		BlobTreeWide<4> wide(*tree);
+		RenderProgressive(&wide, pixels, pixelsCost);
+	}
+	else
+		RenderProgressive(tree, pixels, pixelsCost);
+}
@@ -0,0 +1,164 @@
+#include "renderrequest.h"
+#include "fundamentals.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+/*!
+\brief Skip white spaces.
+\param s string
+\param i current position, updated
+*/
+static void SkipSpaces(const std::string& s, size_t& i)
+{
+	while (i < s.size() && strchr(" \t\r\n", s[i]) != nullptr)
+		i++;
+}
+
+/*!
+\brief Parse a JSON string, escape sequences are kept verbatim except for quotes and backslashes.
+\param s string
+\param i current position, on the opening quote, updated
+\param value returned string
+*/
+static bool ParseString(const std::string& s, size_t& i, std::string& value)
+{
+	if (i >= s.size() || s[i] != '"')
+		return false;
+	value.clear();
+	for (i++; i < s.size() && s[i] != '"'; i++)
+	{
+		if (s[i] == '\\' && i + 1 < s.size())
+			i++;
+		value += s[i];
+	}
+	if (i >= s.size())
+		return false;
+	i++;
+	return true;
+}
+
+/*!
+\brief Parse a JSON number.
+\param s string
+\param i current position, updated
+\param value returned number
+*/
+static bool ParseNumber(const std::string& s, size_t& i, double& value)
+{
+	const char* begin = s.c_str() + i;
+	char* end = nullptr;
+	value = strtod(begin, &end);
+	if (end == begin)
+		return false;
+	i += end - begin;
+	return true;
+}
+
+/*!
+\brief Convert a JSON number to an integer in a range.
+\param number the number
+\param low, high range of valid values
+\param value returned integer
+\return false if the number is out of the range.
+*/
+static bool ToInt(double number, int low, int high, int& value)
+{
+	if (!(number >= double(low) && number <= double(high)))
+		return false;
+	value = int(number);
+	return true;
+}
+
+/*!
+\brief Parse a render request from a flat JSON object.
+\param line the JSON object
+\param request returned request, keys missing from the object keep the value they had
+\return false if the line is not a valid request, if its identifier or image size are out of range, or if its camera is invalid, see Camera::Valid().
+*/
+bool RenderRequest::Parse(const std::string& line, RenderRequest& request)
+{
+	size_t i = 0;
+	SkipSpaces(line, i);
+	if (i >= line.size() || line[i] != '{')
+		return false;
+	i++;
+	SkipSpaces(line, i);
+	if (i < line.size() && line[i] == '}')
+		return true;
+	while (i < line.size())
+	{
+		std::string key;
+		SkipSpaces(line, i);
+		if (!ParseString(line, i, key))
+			return false;
+		SkipSpaces(line, i);
+		if (i >= line.size() || line[i] != ':')
+			return false;
+		i++;
+		SkipSpaces(line, i);
+
+		double number = 0.0;
+		std::string text;
+		if (key == "camera")
+		{
+			if (i >= line.size() || line[i] != '[')
+				return false;
+			i++;
+			double c[3];
+			for (int j = 0; j < 3; j++)
+			{
+				SkipSpaces(line, i);
+				if (!ParseNumber(line, i, c[j]))
+					return false;
+				SkipSpaces(line, i);
+				if (i >= line.size() || line[i] != (j < 2 ? ',' : ']'))
+					return false;
+				i++;
+			}
+			request.camera = Vector(c[0], c[1], c[2]);
+			if (!Camera::Valid(request.camera))
+				return false;
+		}
+		else if (key == "method" || key == "output" || key == "command")
+		{
+			if (!ParseString(line, i, text))
+				return false;
+			if (key == "output")
+				request.output = text;
+			else if (key == "command")
+				request.command = text;
+			else if (text == "sphere")
+				request.method = 0;
+			else if (text == "enhanced")
+				request.method = 1;
+			else if (text == "segment")
+				request.method = 2;
+			else
+				return false;
+		}
+		else if (ParseNumber(line, i, number))
+		{
+			bool valid = true;
+			if (key == "id")
+				valid = ToInt(number, INT_MIN, INT_MAX, request.id);
+			else if (key == "width")
+				valid = ToInt(number, 1, MaxSize, request.width);
+			else if (key == "height")
+				valid = ToInt(number, 1, MaxSize, request.height);
+			if (!valid)
+				return false;
+		}
+		else if (!ParseString(line, i, text))
+			return false;
+
+		SkipSpaces(line, i);
+		if (i < line.size() && line[i] == ',')
+			i++;
+		else if (i < line.size() && line[i] == '}')
+			return request.width > 0 && request.height > 0;
+		else
+			return false;
+	}
+	return false;
+}
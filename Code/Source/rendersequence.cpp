@@ -0,0 +1,191 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include "boundedqueue.h"
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+/*!
+\brief Frame of a particle sequence flowing through the stages of the sequence renderer.
+*/
+struct SequenceFrame
+{
+	int index = 0;							//!< Index of the frame
+	std::vector<Vector>* centers = nullptr;	//!< Loaded particles
+	BlobTree* tree = nullptr;				//!< Built tree
+	BlobTreeWide<4>* wide4 = nullptr;		//!< Wide hierarchy, if settings.hierarchyWidth is 4
+	BlobTreeWide<8>* wide8 = nullptr;		//!< Wide hierarchy, if settings.hierarchyWidth is 8
+};
+
+/*!
+\brief Time spent by a stage of the sequence renderer, either working or waiting for the other stages.
+*/
+struct SequenceStage
+{
+	const char* name;		//!< Name of the stage
+	int frames = 0;			//!< Number of processed frames
+	double busy = 0.0;		//!< Time spent working, in seconds
+	double waiting = 0.0;	//!< Time spent waiting for input or output room, in seconds
+
+	SequenceStage(const char* n) : name(n)
+	{
+	}
+};
+
+/*!
+\brief Check that a printf pattern of frame files has exactly one integer conversion, such as %d or %04d.
+
+Flags, width and precision are allowed, as well as %% escapes, but not the * width nor any other conversion,
+since the pattern is given a single int.
+\param pattern the pattern
+*/
+static bool ValidFramePattern(const char* pattern)
+{
+	int conversions = 0;
+	for (const char* c = pattern; *c != 0; c++)
+	{
+		if (*c != '%')
+			continue;
+		c++;
+		if (*c == '%')
+			continue;
+		while (*c != 0 && strchr("-+ #0", *c) != nullptr)
+			c++;
+		while (isdigit((unsigned char)*c))
+			c++;
+		if (*c == '.')
+		{
+			c++;
+			while (isdigit((unsigned char)*c))
+				c++;
+		}
+		if (*c != 'd' && *c != 'i')
+			return false;
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+/*!
+\brief Render a sequence of particle files with segment tracing.
+
+Loading and parsing of frame N+1, hierarchy construction of frame N, and rendering and encoding of
+frame N-1 run concurrently on three stages connected by bounded queues. The time spent working and
+waiting by every stage is reported at the end, the stage with the lowest throughput being the bottleneck.
+Frames that cannot be read or hold no particle are reported and skipped.
+\param pattern printf pattern of the particle files, with one integer for the frame index, see ValidFramePattern()
+\param first, last range of frames, inclusive
+\param pixels, pixelsCost frame buffers used by the render stage
+*/
+void RenderSequence(const char* pattern, int first, int last, Vector** pixels, Vector** pixelsCost)
+{
+	if (!ValidFramePattern(pattern))
+	{
+		std::cout << "Pattern " << pattern << " should have exactly one integer conversion for the frame index" << std::endl;
+		return;
+	}
+	const int queueCapacity = 2;
+	BoundedQueue<SequenceFrame> loaded(queueCapacity);
+	BoundedQueue<SequenceFrame> built(queueCapacity);
+	SequenceStage load("Load"), build("Build"), render("Render");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::thread loader([&]()
+	{
+		for (int f = first; f <= last; f++)
+		{
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			char path[256];
+			snprintf(path, sizeof(path), pattern, f);
+			SequenceFrame frame;
+			frame.index = f;
+			frame.centers = new std::vector<Vector>();
+			if (!BlobTree::Load(path, *frame.centers))
+			{
+				delete frame.centers;
+				continue;
+			}
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			loaded.Push(frame);
+			load.busy += Seconds(begin, end);
+			load.waiting += Seconds(end, std::chrono::steady_clock::now());
+			load.frames++;
+		}
+		loaded.Close();
+	});
+
+	std::thread builder([&]()
+	{
+		std::chrono::steady_clock::time_point wait = std::chrono::steady_clock::now();
+		SequenceFrame frame;
+		while (loaded.Pop(frame))
+		{
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			if (frame.centers->empty())
+			{
+				// An empty tree has no root, which neither the wide hierarchies nor the tracers expect
+				std::cout << "Frame " << frame.index << " has no particle, skipped" << std::endl;
+				delete frame.centers;
+				continue;
+			}
+			frame.tree = new BlobTree(*frame.centers, 2.25, settings.leafSize);	// Hardcoded radius for the files
+			delete frame.centers;
+			frame.centers = nullptr;
+			if (settings.hierarchyWidth == 4)
+				frame.wide4 = new BlobTreeWide<4>(*frame.tree);
+			else if (settings.hierarchyWidth == 8)
+				frame.wide8 = new BlobTreeWide<8>(*frame.tree);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			built.Push(frame);
+			build.waiting += Seconds(wait, begin);
+			build.busy += Seconds(begin, end);
+			build.frames++;
+			wait = end;
+		}
+		built.Close();
+	});
+
+	// Render stage runs on the main thread, so that the pixel loop can use the OpenMP thread pool
+	std::chrono::steady_clock::time_point wait = std::chrono::steady_clock::now();
+	SequenceFrame frame;
+	while (built.Pop(frame))
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		if (frame.wide4 != nullptr)
+			RenderFrame(frame.wide4, RayTraceMethod::SegmentTracing, frame.tree->K(), pixels, pixelsCost);
+		else if (frame.wide8 != nullptr)
+			RenderFrame(frame.wide8, RayTraceMethod::SegmentTracing, frame.tree->K(), pixels, pixelsCost);
+		else
+			RenderFrame(frame.tree, RayTraceMethod::SegmentTracing, frame.tree->K(), pixels, pixelsCost);
+		char path[64];
+		sprintf(path, "./sequence%04d.ppm", frame.index);
+		if (!WriteToFile(path, pixels))
+			std::cout << "WriteToFile Error - failed to write frame " << frame.index << " to disk" << std::endl;
+		delete frame.wide4;
+		delete frame.wide8;
+		delete frame.tree;
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		render.waiting += Seconds(wait, begin);
+		render.busy += Seconds(begin, end);
+		render.frames++;
+		wait = end;
+	}
+	loader.join();
+	builder.join();
+	double total = Seconds(start, std::chrono::steady_clock::now());
+
+	// Report
+	std::cout << std::setw(8) << "Stage" << std::setw(8) << "Frames" << std::setw(10) << "Busy(s)" << std::setw(10) << "Wait(s)" << std::setw(12) << "Frames/s" << std::endl;
+	const SequenceStage* stages[3] = { &load, &build, &render };
+	const SequenceStage* bottleneck = stages[0];
+	for (const SequenceStage* stage : stages)
+	{
+		std::cout << std::setw(8) << stage->name << std::setw(8) << stage->frames << std::setw(10) << std::setprecision(3) << stage->busy << std::setw(10) << stage->waiting
+			<< std::setw(12) << (stage->busy > 0.0 ? stage->frames / stage->busy : 0.0) << std::endl;
+		if (stage->busy > bottleneck->busy)
+			bottleneck = stage;
+	}
+	std::cout << "Total: " << total << "s, " << render.frames / total << " frames/s, bottleneck: " << bottleneck->name << std::endl;
+}
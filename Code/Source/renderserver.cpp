@@ -0,0 +1,258 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include "boundedqueue.h"
+#include "renderrequest.h"
+#include <iostream>
+#include <thread>
+
+/*!
+\brief Render request being processed by the render server.
+*/
+struct ServerJob
+{
+	RenderRequest request;								//!< Request
+	std::chrono::steady_clock::time_point arrival;		//!< Time the request was read
+	bool valid = true;									//!< False if the request could not be parsed
+	std::vector<Vector> pixels;							//!< Image, row by row
+};
+
+/*!
+\brief Escape a string for writing it between the quotes of a JSON string.
+\param s the string
+*/
+std::string EscapeJson(const std::string& s)
+{
+	std::string escaped;
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)(c) < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", (unsigned char)(c));
+			escaped += code;
+		}
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+/*!
+\brief Latency and throughput of the render server.
+*/
+struct ServerMetrics
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();	//!< Start of the server
+	int batches = 0;				//!< Number of rendered batches
+	long long pixels = 0;			//!< Number of rendered pixels
+	std::vector<double> latencies;	//!< Latency of every rendered request, in milliseconds
+
+	/*!
+	\brief Print the metrics as a JSON object on a single line.
+	*/
+	void Print() const
+	{
+		std::vector<double> sorted = latencies;
+		std::sort(sorted.begin(), sorted.end());
+		double elapsed = Seconds(start, std::chrono::steady_clock::now());
+		double mean = 0.0;
+		for (double l : sorted)
+			mean += l;
+		mean = sorted.empty() ? 0.0 : mean / double(sorted.size());
+		double p50 = sorted.empty() ? 0.0 : sorted[sorted.size() / 2];
+		double p95 = sorted.empty() ? 0.0 : sorted[(sorted.size() * 95) / 100];
+		double worst = sorted.empty() ? 0.0 : sorted.back();
+		std::cout << "{\"requests\": " << sorted.size() << ", \"batches\": " << batches << ", \"requests_per_s\": " << double(sorted.size()) / elapsed
+			<< ", \"mpixels_per_s\": " << double(pixels) / elapsed * 1e-6 << ", \"latency_ms\": {\"mean\": " << mean << ", \"p50\": " << p50
+			<< ", \"p95\": " << p95 << ", \"max\": " << worst << "}}" << std::endl;
+	}
+};
+
+/*!
+\brief Side of the square tiles shared by the requests of a batch.
+*/
+const int ServerTile = 16;
+
+/*!
+\brief Render a tile of a request with a given tracer configuration.
+\param field implicit field
+\param camera camera of the request
+\param job the request
+\param x, y lower corner of the tile
+*/
+template<StepPolicy policy, int overstep, int acceleration, typename Field>
+void RenderTile(const Field* field, const Camera& camera, ServerJob& job, int x, int y)
+{
+	ProfileScope scope("Render tile");
+	const RenderRequest& r = job.request;
+	for (int j = y; j < min(y + ServerTile, r.height); j++)
+	{
+		for (int i = x; i < min(x + ServerTile, r.width); i++)
+		{
+			Vector cost;
+			PixelColor<policy, overstep, acceleration, NoStats>(field, camera.PixelRay(i, j), field->K(), settings.tracing, job.pixels[j * r.width + i], cost);
+		}
+	}
+}
+
+/*!
+\brief Render a batch of requests, whose tiles are gathered in a single queue processed in parallel.
+
+Tiles are sorted by method so that threads mostly run the same tracer.
+\param field implicit field
+\param batch requests
+*/
+template<typename Field>
+void RenderBatch(const Field* field, std::vector<ServerJob*>& batch)
+{
+	struct Tile
+	{
+		ServerJob* job;
+		const Camera* camera;
+		int x, y;
+	};
+	std::vector<Camera> cameras;
+	cameras.reserve(batch.size());
+	std::vector<Tile> tiles;
+	for (ServerJob* job : batch)
+	{
+		job->pixels.assign(size_t(job->request.width) * job->request.height, Vector(0));
+		cameras.push_back(Camera(job->request.camera, job->request.width, job->request.height));
+		for (int y = 0; y < job->request.height; y += ServerTile)
+			for (int x = 0; x < job->request.width; x += ServerTile)
+				tiles.push_back({ job, &cameras.back(), x, y });
+	}
+	std::stable_sort(tiles.begin(), tiles.end(), [](const Tile& a, const Tile& b) { return a.job->request.method < b.job->request.method; });
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < int(tiles.size()); t++)
+	{
+		const Tile& tile = tiles[t];
+		switch (tile.job->request.method)
+		{
+		case SphereTracing:
+			RenderTile<GlobalBound, 100, 100>(field, *tile.camera, *tile.job, tile.x, tile.y);
+			break;
+		case EnhancedSphereTracing:
+			RenderTile<GlobalBound, 125, 100>(field, *tile.camera, *tile.job, tile.x, tile.y);
+			break;
+		default:
+			RenderTile<SegmentBound, 100, 150>(field, *tile.camera, *tile.job, tile.x, tile.y);
+			break;
+		}
+	}
+}
+
+/*!
+\brief Run the render server: the scene stays loaded while render requests are read from the standard input.
+
+Requests are JSON objects, one per line, see RenderRequest. A reader thread queues them as they arrive,
+and all the requests queued while the previous batch was rendered form the next batch. Rendered images are written
+to disk, and a JSON response with the latency of the request is printed on the standard output for every request.
+Metrics are printed in response to a "stats" command and when the input is closed.
+\param field implicit field
+*/
+template<typename Field>
+void Serve(const Field* field)
+{
+	const int maxBatch = 16;
+	BoundedQueue<ServerJob*> queue(256);
+	ServerMetrics metrics;
+
+	std::thread reader([&queue]()
+	{
+		for (std::string line; std::getline(std::cin, line); /* empty */)
+		{
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+				continue;
+			ServerJob* job = new ServerJob;
+			job->arrival = std::chrono::steady_clock::now();
+			job->request.width = settings.width;
+			job->request.height = settings.height;
+			job->request.camera = settings.camera;
+			job->request.method = settings.method < 0 ? int(SegmentTracing) : settings.method;
+			job->valid = RenderRequest::Parse(line, job->request);
+			bool quit = job->valid && job->request.command == "quit";
+			queue.Push(job);
+			if (quit)
+				break;
+		}
+		queue.Close();
+	});
+
+	bool running = true;
+	ServerJob* job = nullptr;
+	while (running && queue.Pop(job))
+	{
+		// Gather the render requests already queued, a command ends the batch
+		std::vector<ServerJob*> batch;
+		ServerJob* command = nullptr;
+		do
+		{
+			if (job->valid && job->request.command == "render")
+				batch.push_back(job);
+			else
+				command = job;
+		} while (command == nullptr && int(batch.size()) < maxBatch && queue.TryPop(job));
+
+		if (!batch.empty())
+		{
+			RenderBatch(field, batch);
+			metrics.batches++;
+			for (ServerJob* b : batch)
+			{
+				const RenderRequest& r = b->request;
+				std::string output = r.output.empty() ? "./view" + std::to_string(r.id) + ".ppm" : r.output;
+				bool written = WriteToFile(output.c_str(), b->pixels, r.width, r.height);
+				double latency = 1000.0 * Seconds(b->arrival, std::chrono::steady_clock::now());
+				metrics.latencies.push_back(latency);
+				metrics.pixels += (long long)(r.width) * r.height;
+				std::cout << "{\"id\": " << r.id << ", \"status\": \"" << (written ? "ok" : "error") << "\", \"output\": \"" << EscapeJson(output)
+					<< "\", \"batch\": " << batch.size() << ", \"latency_ms\": " << latency << "}" << std::endl;
+				delete b;
+			}
+		}
+
+		if (command != nullptr)
+		{
+			if (!command->valid)
+				std::cout << "{\"status\": \"error\", \"message\": \"invalid request\"}" << std::endl;
+			else if (command->request.command == "stats")
+				metrics.Print();
+			else if (command->request.command == "quit")
+				running = false;
+			else
+				std::cout << "{\"id\": " << command->request.id << ", \"status\": \"error\", \"message\": \"unknown command\"}" << std::endl;
+			delete command;
+		}
+	}
+	reader.join();
+	while (queue.TryPop(job))
+		delete job;
+	metrics.Print();
+}
+
+/*!
+\brief Serve render requests with the hierarchy selected by settings.hierarchyWidth.
+*/
+void Serve()
+{
+	if (settings.hierarchyWidth == 8)
+	{
+		BlobTreeWide<8> wide(*tree);
+		Serve(&wide);
+	}
+	else if (settings.hierarchyWidth == 4)
+	{
+		BlobTreeWide<4> wide(*tree);
+		Serve(&wide);
+	}
+	else
+		Serve(tree);
+}
@@ -0,0 +1,214 @@
+#include "rendersettings.h"
+#include "fundamentals.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+/*!
+\brief Number of values expected by a key, 0 if the key is unknown.
+\param key the key
+*/
+static int ValueCount(const std::string& key)
+{
+	if (key == "camera")
+		return 3;
+	if (key == "width" || key == "height" || key == "method" || key == "scene" || key == "leaf-size" || key == "hierarchy-width" || key == "quantization" || key == "refine" || key == "min-step" || key == "bound" || key == "trace" || key == "config")
+		return 1;
+	return 0;
+}
+
+/*!
+\brief Convert a string to an integer.
+\param s string
+\param value returned integer
+\return false if the string is not an integer or does not fit in an int.
+*/
+static bool ToInt(const std::string& s, int& value)
+{
+	char* end = nullptr;
+	errno = 0;
+	long v = strtol(s.c_str(), &end, 10);
+	if (s.empty() || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+		return false;
+	value = int(v);
+	return true;
+}
+
+/*!
+\brief Convert a string to a double.
+\param s string
+\param value returned double
+\return false if the string is not a number.
+*/
+static bool ToDouble(const std::string& s, double& value)
+{
+	char* end = nullptr;
+	value = strtod(s.c_str(), &end);
+	return !s.empty() && *end == '\0';
+}
+
+/*!
+\brief Set a parameter.
+\param key the key, see RenderSettings
+\param values values of the parameter
+\return false if the key is unknown or the values are invalid.
+*/
+bool RenderSettings::Set(const std::string& key, const std::vector<std::string>& values)
+{
+	if (int(values.size()) != ValueCount(key))
+	{
+		std::cout << "Invalid parameter " << key << std::endl;
+		return false;
+	}
+	bool valid = true;
+	if (key == "config")
+		return Load(values[0].c_str());
+	else if (key == "width")
+		valid = ToInt(values[0], width) && width > 0;
+	else if (key == "height")
+		valid = ToInt(values[0], height) && height > 0;
+	else if (key == "camera")
+	{
+		double c[3] = { 0.0, 0.0, 0.0 };
+		valid = ToDouble(values[0], c[0]) && ToDouble(values[1], c[1]) && ToDouble(values[2], c[2]);
+		valid = valid && Camera::Valid(Vector(c[0], c[1], c[2]));
+		if (valid)
+			camera = Vector(c[0], c[1], c[2]);
+	}
+	else if (key == "method")
+	{
+		const char* names[] = { "sphere", "enhanced", "segment" };
+		method = -2;
+		for (int i = 0; i < 3; i++)
+			if (values[0] == names[i])
+				method = i;
+		if (values[0] == "all")
+			method = -1;
+		valid = method != -2;
+	}
+	else if (key == "scene")
+		scene = values[0];
+	else if (key == "trace")
+		trace = values[0];
+	else if (key == "leaf-size")
+		valid = ToInt(values[0], leafSize) && leafSize > 0;
+	else if (key == "hierarchy-width")
+		valid = ToInt(values[0], hierarchyWidth) && (hierarchyWidth == 2 || hierarchyWidth == 4 || hierarchyWidth == 8);
+	else if (key == "quantization")
+		valid = ToInt(values[0], quantizationBits) && (quantizationBits == 0 || quantizationBits == 8 || quantizationBits == 16);
+	else if (key == "refine")
+		valid = ToDouble(values[0], tracing.tolerance) && tracing.tolerance >= 0.0;
+	else if (key == "min-step")
+		valid = ToDouble(values[0], tracing.minStep) && tracing.minStep > 0.0;
+	else if (key == "bound")
+	{
+		valid = values[0] == "sum" || values[0] == "directional";
+		directionalBound = values[0] == "directional";
+	}
+	if (!valid)
+		std::cout << "Invalid value for parameter " << key << std::endl;
+	return valid;
+}
+
+/*!
+\brief Load parameters from a configuration file.
+\param path file path
+\return false if the file could not be read, holds an invalid parameter, or includes itself directly or through other files.
+*/
+bool RenderSettings::Load(const char* path)
+{
+	const int maxDepth = 16;
+	if (std::find(loading.begin(), loading.end(), std::string(path)) != loading.end() || int(loading.size()) >= maxDepth)
+	{
+		std::cout << "Configuration file " << path << " includes itself or is nested too deeply" << std::endl;
+		return false;
+	}
+	std::ifstream in(path);
+	if (!in)
+	{
+		std::cout << "Unable to open configuration file " << path << std::endl;
+		return false;
+	}
+	loading.push_back(path);
+	bool valid = true;
+	for (std::string line; valid && std::getline(in, line); /* empty */)
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream tokens(line);
+		std::string key;
+		if (!(tokens >> key))
+			continue;
+		std::vector<std::string> values;
+		for (std::string v; tokens >> v; /* empty */)
+			values.push_back(v);
+		valid = Set(key, values);
+	}
+	loading.pop_back();
+	return valid;
+}
+
+/*!
+\brief Parse the command line.
+\param argc, argv command line
+\param args returned arguments that are not render parameters, such as the benchmark modes
+\return false if a parameter is invalid.
+*/
+bool RenderSettings::Parse(int argc, char** argv, std::vector<std::string>& args)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		int count = arg.compare(0, 2, "--") == 0 ? ValueCount(arg.substr(2)) : 0;
+		if (count == 0)
+		{
+			args.push_back(arg);
+			continue;
+		}
+		if (i + count >= argc)
+		{
+			std::cout << "Missing value for parameter " << arg << std::endl;
+			return false;
+		}
+		std::vector<std::string> values(argv + i + 1, argv + i + 1 + count);
+		if (!Set(arg.substr(2), values))
+			return false;
+		i += count;
+	}
+	return true;
+}
+
+/*!
+\brief Command line reproducing the parameters, used for launching processes with the same settings.
+
+The trace is left out, so that processes launched with the arguments do not overwrite the trace of their parent.
+*/
+std::vector<std::string> RenderSettings::Arguments() const
+{
+	auto text = [](double value)
+	{
+		std::ostringstream out;
+		out << std::setprecision(17) << value;
+		return out.str();
+	};
+	const char* names[] = { "sphere", "enhanced", "segment" };
+	return std::vector<std::string>{ "--width", std::to_string(width), "--height", std::to_string(height),
+		"--camera", text(camera[0]), text(camera[1]), text(camera[2]), "--method", method < 0 ? "all" : names[method],
+		"--scene", scene, "--leaf-size", std::to_string(leafSize), "--hierarchy-width", std::to_string(hierarchyWidth),
+		"--quantization", std::to_string(quantizationBits), "--refine", text(tracing.tolerance), "--min-step", text(tracing.minStep),
+		"--bound", directionalBound ? "directional" : "sum" };
+}
+
+/*!
+\brief Print the list of render parameters.
+*/
+void RenderSettings::Usage()
+{
+	std::cout << "Parameters: --width n --height n --camera x y z --method sphere|enhanced|segment|all --scene path" << std::endl;
+	std::cout << "            --leaf-size n --hierarchy-width 2|4|8 --quantization 0|8|16 --refine tolerance --min-step d" << std::endl;
+	std::cout << "            --bound sum|directional --trace path --config path" << std::endl;
+}
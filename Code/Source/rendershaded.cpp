@@ -0,0 +1,163 @@
+#include "modes.h"
+#include "tracing.h"
+#include "blobtreewide.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+/*!
+\brief Render the scene with segment tracing, shadows and optional ambient occlusion.
+
+The image is processed by tiles: primary rays of a tile are traced first, then the shadow rays toward sunDir
+of all its hits, then their ambient occlusion rays, so that every batch of rays is coherent. Secondary rays
+use the any-hit tracer. Ray count, steps and time of every kind of ray are reported separately, times being
+summed over threads. The cost image holds the steps of the primary, shadow and ambient occlusion rays of every pixel.
+\param field implicit field
+\param aoRays number of ambient occlusion rays per hit, 0 to disable ambient occlusion
+\param pixels, pixelsCost frame buffers
+*/
+template<typename Field>
+void RenderShaded(const Field* field, int aoRays, Vector** pixels, Vector** pixelsCost)
+{
+	const int tileSize = 16;
+	const double bias = 0.05;		// Offset of the origin of secondary rays along the normal
+	const double aoDistance = 4.0;	// Length of ambient occlusion rays
+	const int w = settings.width;
+	const int h = settings.height;
+	const Camera camera(settings.camera, w, h);
+	const double k = field->K();
+
+	struct Hit
+	{
+		int x, y;
+		Vector p, n;
+		bool lit;
+		int open;
+		int steps;
+	};
+
+	const int tw = (w + tileSize - 1) / tileSize;
+	const int th = (h + tileSize - 1) / tileSize;
+	long long rays[3] = { 0, 0, 0 };
+	long long steps[3] = { 0, 0, 0 };
+	double times[3] = { 0.0, 0.0, 0.0 };
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int tile = 0; tile < tw * th; tile++)
+	{
+		ProfileScope scope("Render tile");
+		const int x0 = (tile % tw) * tileSize;
+		const int y0 = (tile / tw) * tileSize;
+		long long tileRays[3] = { 0, 0, 0 };
+		long long tileSteps[3] = { 0, 0, 0 };
+		double tileTimes[3];
+		std::vector<Hit> hits;
+
+		// Primary rays
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		for (int x = x0; x < min(x0 + tileSize, w); x++)
+		{
+			for (int y = y0; y < min(y0 + tileSize, h); y++)
+			{
+				Ray ray = camera.PixelRay(x, y);
+				PixelSample sample = TracePixel<SegmentBound, 100, 150, StepCount>(field, ray, k, settings.tracing);
+				tileRays[0]++;
+				tileSteps[0] += sample.steps;
+				pixels[x][y] = Vector(0);
+				pixelsCost[x][y] = Vector(0, Math::Min(double(sample.steps) / 512.0, 1.0) * 255.0, 0);
+				if (sample.hit)
+					hits.push_back({ x, y, ray(sample.t), sample.normal, sample.normal * sunDir > 0.0, aoRays, sample.steps });
+			}
+		}
+
+		// Shadow rays of the tile
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		for (Hit& hit : hits)
+		{
+			if (!hit.lit)
+				continue;
+			int s = 0;
+			hit.lit = !TraceAnyHit<150, StepCount>(field, Ray(hit.p + hit.n * bias, sunDir), Math::Infinity, s);
+			hit.steps += s;
+			tileRays[1]++;
+			tileSteps[1] += s;
+		}
+
+		// Ambient occlusion rays of the tile, cosine weighted around the normal
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+		for (int n = 0; n < (aoRays > 0 ? int(hits.size()) : 0); n++)
+		{
+			Hit& hit = hits[n];
+			std::mt19937 gen(hit.y * w + hit.x);
+			std::uniform_real_distribution<double> unit(0.0, 1.0);
+			Vector u, v;
+			hit.n.Orthonormal(u, v);
+			for (int r = 0; r < aoRays; r++)
+			{
+				double phi = 2.0 * Math::Pi * unit(gen);
+				double sin2 = unit(gen);
+				Vector d = u * (cos(phi) * sqrt(sin2)) + v * (sin(phi) * sqrt(sin2)) + hit.n * sqrt(1.0 - sin2);
+				int s = 0;
+				if (TraceAnyHit<150, StepCount>(field, Ray(hit.p + hit.n * bias, d), aoDistance, s))
+					hit.open--;
+				hit.steps += s;
+				tileRays[2]++;
+				tileSteps[2] += s;
+			}
+		}
+		std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+		tileTimes[0] = Seconds(t0, t1);
+		tileTimes[1] = Seconds(t1, t2);
+		tileTimes[2] = Seconds(t2, t3);
+
+		// Diffuse lighting with ambient term, both attenuated by occlusion
+		for (const Hit& hit : hits)
+		{
+			double ao = aoRays > 0 ? 0.5 + 0.5 * double(hit.open) / double(aoRays) : 1.0;
+			double NDotL = hit.lit ? hit.n * sunDir : 0.0;
+			pixels[hit.x][hit.y] = Vector(255 * Math::Max(NDotL, 0.1) * ao, 0, 0);
+			pixelsCost[hit.x][hit.y] = Vector(0, Math::Min(double(hit.steps) / 512.0, 1.0) * 255.0, 0);
+		}
+
+#pragma omp critical
+		for (int j = 0; j < 3; j++)
+		{
+			rays[j] += tileRays[j];
+			steps[j] += tileSteps[j];
+			times[j] += tileTimes[j];
+		}
+	}
+	double total = Seconds(begin, std::chrono::steady_clock::now());
+
+	if (!WriteToFile("./shaded.ppm", pixels))
+		std::cout << "WriteToFile Error - failed to write image to disk" << std::endl;
+	if (!WriteToFile("./shaded_cost.ppm", pixelsCost))
+		std::cout << "WriteToFile Error - failed to write cost image to disk" << std::endl;
+	const char* names[3] = { "Primary", "Shadow", "AO" };
+	std::cout << std::setw(10) << "Rays" << std::setw(10) << "Count" << std::setw(12) << "Steps" << std::setw(12) << "Steps/ray" << std::setw(10) << "Time(ms)" << std::endl;
+	for (int j = 0; j < 3; j++)
+		std::cout << std::setw(10) << names[j] << std::setw(10) << rays[j] << std::setw(12) << steps[j] << std::setw(12) << std::setprecision(3) << (rays[j] > 0 ? double(steps[j]) / double(rays[j]) : 0.0)
+			<< std::setw(10) << int(1000.0 * times[j]) << std::endl;
+	std::cout << "Total: " << int(1000.0 * total) << "ms" << std::endl;
+}
+
+/*!
+\brief Render the scene with shadows and ambient occlusion with the hierarchy selected by settings.hierarchyWidth.
+\param aoRays number of ambient occlusion rays per pixel, 0 for shadows only
+\param pixels, pixelsCost frame buffers
+*/
+void RenderShaded(int aoRays, Vector** pixels, Vector** pixelsCost)
+{
+	if (settings.hierarchyWidth == 8)
+	{
+		BlobTreeWide<8> wide(*tree);
+		RenderShaded(&wide, aoRays, pixels, pixelsCost);
+	}
+	else if (settings.hierarchyWidth == 4)
+	{
+		BlobTreeWide<4> wide(*tree);
+		RenderShaded(&wide, aoRays, pixels, pixelsCost);
+	}
+	else
+		RenderShaded(tree, aoRays, pixels, pixelsCost);
+}
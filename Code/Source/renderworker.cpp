@@ -0,0 +1,80 @@
+#include "modes.h"
+#include "tracing.h"
+#include "distributed.h"
+#include "blobtreewide.h"
+#include "localsocket.h"
+
+/*!
+\brief Render the pixels of a tile of a distributed render.
+\param field implicit field
+\param camera camera of the frame
+\param tile the tile
+\param colors, costs returned colors and costs, row by row
+*/
+template<StepPolicy policy, typename Field>
+void RenderWorkerTile(const Field* field, const Camera& camera, const DistributedTile& tile, std::vector<Vector>& colors, std::vector<Vector>& costs)
+{
+	ProfileScope scope("Render tile");
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int j = 0; j < tile.h; j++)
+		for (int i = 0; i < tile.w; i++)
+			PixelColor<policy, 100, 150, StepCount>(field, camera.PixelRay(tile.x + i, tile.y + j), field->K(), settings.tracing, colors[j * tile.w + i], costs[j * tile.w + i]);
+}
+
+/*!
+\brief Run a worker of a distributed render.
+
+The worker loads the hierarchy from the binary cache, connects to the coordinator and renders the tiles it receives
+with segment tracing until it receives an empty tile. The pixels of every tile are sent back as colors and costs, row by row.
+\param socket socket of the coordinator
+\param cache binary cache of the hierarchy, see BlobTreeWide::Write()
+\param id index of the worker, sent back to the coordinator once connected
+\return false if the cache could not be read or the connection was lost.
+*/
+template<int W>
+bool RenderWorker(const char* socket, const char* cache, int id)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	PointBuffer points;
+	BlobTreeWide<W> wide(cache, &points);
+	if (wide.GetNodes().empty())
+		return false;
+	DistributedHello hello = { Seconds(begin, std::chrono::steady_clock::now()), int32_t(omp_get_max_threads()), int32_t(id) };
+	int s = LocalSocket::Connect(socket);
+	if (s < 0 || !LocalSocket::Send(s, &hello, sizeof(hello)))
+	{
+		LocalSocket::Close(s);
+		return false;
+	}
+
+	const Camera camera(settings.camera, settings.width, settings.height);
+	std::vector<Vector> colors;
+	std::vector<Vector> costs;
+	DistributedTile tile;
+	bool connected = true;
+	while (connected && (connected = LocalSocket::Receive(s, &tile, sizeof(tile))) && tile.w > 0 && tile.h > 0)
+	{
+		colors.assign(size_t(tile.w) * tile.h, Vector(0));
+		costs.assign(size_t(tile.w) * tile.h, Vector(0));
+		if (settings.directionalBound)
+			RenderWorkerTile<DirectionalBound>(&wide, camera, tile, colors, costs);
+		else
+			RenderWorkerTile<SegmentBound>(&wide, camera, tile, colors, costs);
+		connected = LocalSocket::Send(s, &tile, sizeof(tile)) && LocalSocket::Send(s, colors.data(), colors.size() * sizeof(Vector))
+			&& LocalSocket::Send(s, costs.data(), costs.size() * sizeof(Vector));
+	}
+	LocalSocket::Close(s);
+	return connected;
+}
+
+/*!
+\brief Run a worker of a distributed render with the wide hierarchy selected by settings.hierarchyWidth.
+\param socket socket of the coordinator
+\param cache binary cache of the hierarchy
+\param id index of the worker
+\return false if the cache could not be read or the connection was lost.
+*/
+bool RenderWorker(const char* socket, const char* cache, int id)
+{
+	return settings.hierarchyWidth == 8 ? RenderWorker<8>(socket, cache, id) : RenderWorker<4>(socket, cache, id);
+}
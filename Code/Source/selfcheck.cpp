@@ -0,0 +1,34 @@
+#include "modes.h"
+#include "tracing.h"
+#include <iomanip>
+#include <iostream>
+
+/*!
+\brief Run the modes that check their own results, and report those that fail.
+
+The precomputed lipschitz bounds are compared to the reference, the slab test of wide nodes to the test of one box at
+a time, refined hits to the surface, the frame rendered by the analyzer to the frame rendered by the tree, the pruned
+mesh to the full mesh, and the frame rendered by two worker processes to the frame rendered by this process.
+\param pixels, pixelsCost frame buffers
+\return false if some check fails.
+*/
+bool SelfCheck(Vector** pixels, Vector** pixelsCost)
+{
+	const char* names[6] = { "--bench-kernel", "--bench-slab", "--bench-refine", "--analyze", "--polygonize", "--distributed" };
+	bool passed[6];
+	passed[0] = BenchmarkKernel();
+	passed[1] = BenchmarkSlab();
+	passed[2] = BenchmarkRefine();
+	passed[3] = AnalyzeHierarchy(pixels, pixelsCost);
+	passed[4] = Polygonize(64, 4);
+	passed[5] = RenderDistributed(2, 32, pixels, pixelsCost);
+
+	bool all = true;
+	std::cout << std::endl;
+	for (int i = 0; i < 6; i++)
+	{
+		std::cout << std::setw(16) << names[i] << (passed[i] ? "  passed" : "  FAILED") << std::endl;
+		all = all && passed[i];
+	}
+	return all;
+}
@@ -0,0 +1,111 @@
+#include "spaceoctree.h"
+#include <chrono>
+
+/*!
+\brief Classify a cell from the field value at its center and the lipschitz bound over its box.
+\param tree the tree
+\param cell box of the cell
+*/
+SpaceLabel SpaceOctree::Classify(const BlobTree& tree, const Box& cell)
+{
+	double f = tree.Intensity(cell.Center());
+	double bound = tree.K(cell) * 0.5 * Norm(cell.Diagonal());
+	if (f < -bound)
+		return EmptySpace;
+	if (f > bound)
+		return FullSpace;
+	return SurfaceSpace;
+}
+
+/*!
+\brief Build the octree over the box of a tree.
+
+The octree is built level by level: the children of the surface cells of a level are allocated
+consecutively, and then classified in parallel.
+\param tree the tree
+\param maxDepth maximum depth of the leaves, surface cells at this depth are not subdivided
+*/
+SpaceOctree::SpaceOctree(const BlobTree& tree, int maxDepth) : box(tree.GetBox())
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	nodes.push_back(Node{ -1, Classify(tree, box) });
+	std::vector<int> level(1, 0);
+	std::vector<Box> boxes(1, box);
+	stats.queries = 2;
+	for (int depth = 0; depth < maxDepth; depth++)
+	{
+		std::vector<int> next;
+		std::vector<Box> nextBoxes;
+		for (int i = 0; i < int(level.size()); i++)
+		{
+			if (nodes[level[i]].label != SurfaceSpace)
+				continue;
+			nodes[level[i]].children = int(nodes.size());
+			for (int j = 0; j < 8; j++)
+			{
+				next.push_back(int(nodes.size()));
+				nextBoxes.push_back(Child(boxes[i], j));
+				nodes.push_back(Node{ -1, SurfaceSpace });
+			}
+		}
+		if (next.empty())
+			break;
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int i = 0; i < int(next.size()); i++)
+			nodes[next[i]].label = Classify(tree, nextBoxes[i]);
+		stats.queries += 2 * next.size();
+		stats.depth = depth + 1;
+		level.swap(next);
+		boxes.swap(nextBoxes);
+	}
+
+	stats.nodes = int(nodes.size());
+	for (int i = 0; i < stats.nodes; i++)
+		if (nodes[i].children < 0)
+			stats.leaves[nodes[i].label]++;
+	stats.memory = nodes.size() * sizeof(Node);
+	scale = double(1 << stats.depth) * box.Diagonal().Inverse();
+	stats.buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/*!
+\brief Locate the leaf containing a sample of a ray.
+
+The sample is converted to integer coordinates on the lattice of the cells of the deepest level,
+whose bits select the child at every level of the descent.
+\param ray the ray
+\param t depth of the sample
+\param exit returned depth at which the ray leaves the leaf, t if the sample is outside of the octree
+\return the label of the leaf, SurfaceSpace if the sample is outside of the octree.
+*/
+SpaceLabel SpaceOctree::Locate(const Ray& ray, double t, double& exit) const
+{
+	exit = t;
+	Vector p = ray(t);
+	if (!box.Inside(p))
+		return SurfaceSpace;
+	const int last = (1 << stats.depth) - 1;
+	int q[3];
+	for (int j = 0; j < 3; j++)
+		q[j] = Math::Clamp(int((p[j] - box[0][j]) * scale[j]), 0, last);
+	int i = 0;
+	int level = stats.depth;
+	while (nodes[i].children >= 0)
+	{
+		level--;
+		i = nodes[i].children + (((q[0] >> level) & 1) | (((q[1] >> level) & 1) << 1) | (((q[2] >> level) & 1) << 2));
+	}
+
+	// Box of the leaf on the lattice
+	exit = Math::Infinity;
+	for (int j = 0; j < 3; j++)
+	{
+		double a = box[0][j] + double((q[j] >> level) << level) / scale[j];
+		double b = box[0][j] + double(((q[j] >> level) + 1) << level) / scale[j];
+		if (ray.d[j] > 0.0)
+			exit = Math::Min(exit, (b - ray.o[j]) / ray.d[j]);
+		else if (ray.d[j] < 0.0)
+			exit = Math::Min(exit, (a - ray.o[j]) / ray.d[j]);
+	}
+	return SpaceLabel(nodes[i].label);
+}
@@ -0,0 +1,70 @@
+#include "tracing.h"
+#include <cstdio>
+#include <iostream>
+
+RenderSettings settings;
+const Vector sunDir = Vector(0.0f, -1.0f, 0.0f);
+BlobTree* tree = nullptr;
+
+/*!
+\brief Export an array of pixels in a ppm file.
+\param path file path
+\param pixels array of RGBA pixels.
+\return true of function terminated properly, false otherwise.
+*/
+bool WriteToFile(const char* path, Vector** pixels)
+{
+	ProfileScope scope("Write image");
+	FILE* fp = NULL;
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+	{
+		std::cout << "Couldn't write to file - exiting" << std::endl;
+		return false;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", settings.width, settings.height);
+	for (int i = 0; i < settings.height; i++)
+	{
+		for (int j = 0; j < settings.width; j++)
+		{
+			static unsigned char color[3];
+			Vector c = pixels[j][i];
+			color[0] = ((int)c[0]) % 256;
+			color[1] = ((int)c[1]) % 256;
+			color[2] = ((int)c[2]) % 256;
+			(void)fwrite(color, 1, 3, fp);
+		}
+	}
+	fclose(fp);
+	return true;
+}
+
+/*!
+\brief Export an image stored row by row in a ppm file.
+\param path file path
+\param pixels RGBA pixels, row by row
+\param width, height image resolution
+\return true of function terminated properly, false otherwise.
+*/
+bool WriteToFile(const char* path, const std::vector<Vector>& pixels, int width, int height)
+{
+	ProfileScope scope("Write image");
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row(3 * width);
+	for (int i = 0; i < height; i++)
+	{
+		for (int j = 0; j < width; j++)
+		{
+			Vector c = pixels[i * width + j];
+			row[3 * j] = ((int)c[0]) % 256;
+			row[3 * j + 1] = ((int)c[1]) % 256;
+			row[3 * j + 2] = ((int)c[2]) % 256;
+		}
+		(void)fwrite(row.data(), 1, row.size(), fp);
+	}
+	fclose(fp);
+	return true;
+}
@@ -14,6 +14,8 @@ solution "SegmentTracing"
 	configuration "linux"
 		buildoptions { "-mtune=native -march=native" }
 		buildoptions { "-std=c++14" }
+		buildoptions { "-ffp-contract=off" }
+		buildoptions { "-fopenmp" }
 		buildoptions { "-w" }
 		buildoptions { "-flto -g"}
 		linkoptions { "-fopenmp"}